@@ -0,0 +1,30 @@
+#ifndef _CAMERAPATH_H_
+#define _CAMERAPATH_H_
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+/**
+ * A deterministic camera path for benchmarking: one full turn
+ * around the model, while slowly tilting up and down.
+ * The rotation for a frame depends only on the frame number.
+ */
+class CameraPath {
+public:
+	CameraPath(unsigned int n_frames) : n_frames(n_frames) {}
+
+	glm::mat4 getRotation(unsigned int frame) const {
+		float t = (frame % n_frames) / static_cast<float>(n_frames);
+		float yaw = 360.0f*t;
+		float pitch = 20.0f*std::sin(2.0f*3.141592653f*t);
+		glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), pitch, glm::vec3(1.0f, 0.0f, 0.0f));
+		return glm::rotate(rotation, yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+
+private:
+	unsigned int n_frames;
+};
+
+#endif // _CAMERAPATH_H_
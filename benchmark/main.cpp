@@ -0,0 +1,408 @@
+#include "GameManager.h"
+#include "PassProfiler.h"
+#include "Timer.h"
+#include "CameraPath.h"
+#include "RecursiveBlur.h"
+#include "AllocationTracker.h"
+#include "ResourceRegistry.h"
+#include "Tracer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Headless benchmark: renders a scripted camera path for a fixed
+ * number of frames in every combination of filter mode, resolution
+ * and downscale level, and reports frame time percentiles as JSON.
+ *
+ * Usage: benchmark [--frames N] [--warmup N] [--resolutions 800x600,1920x1080]
+ *                  [--downscale 2,3,4] [--modes standard,blur,greyscale,combo]
+ *                  [--label text] [--output file.json] [--trace trace.json]
+ *                  [--antialiasing none|msaa|fxaa] [--blur fragment|compute]
+ *                  [--deferred LIGHTS]
+ *
+ * benchmark --validate-blur compares the CPU recursive and box blurs
+ * against the 11-tap kernel and exits, without creating a window.
+ *
+ * Each pass also reports its shader invocations, samples passed and
+ * estimated memory traffic per frame.
+ *
+ * With --deferred, the scene is rendered with clustered deferred
+ * shading and the given number of lights, instead of forward shading.
+ *
+ * Heap allocations in the measured frames are reported for each run.
+ * With --assert-zero-allocations, the benchmark fails if there are any.
+ */
+
+namespace {
+
+struct Config {
+	Config() : frames(300), warmup(30), antialiasing(ANTIALIAS_NONE), compute_blur(false), deferred_lights(0),
+		validate_blur(false), assert_zero_allocations(false) {}
+	unsigned int frames;
+	unsigned int warmup;
+	std::vector<std::pair<unsigned int, unsigned int> > resolutions;
+	std::vector<unsigned int> downscale_levels;
+	std::vector<RenderMode> modes;
+	Antialiasing antialiasing;
+	bool compute_blur; //< Run the downscaled blur in compute shaders
+	unsigned int deferred_lights; //< Lights for deferred shading, or 0 for forward shading
+	std::string label;
+	std::string output;
+	std::string trace; //< Chrome trace of the CPU scopes, if not empty
+	bool validate_blur;
+	bool assert_zero_allocations;
+};
+
+/**
+ * Samples of one timed quantity, in milliseconds
+ */
+class Samples {
+public:
+	void add(double ms) { values.push_back(ms); }
+
+	void writeJSON(std::ostream& out) {
+		std::sort(values.begin(), values.end());
+		double sum = 0.0;
+		for (size_t i=0; i<values.size(); ++i) sum += values[i];
+
+		out << "{\"samples\": " << values.size();
+		if (!values.empty()) {
+			out << ", \"mean\": " << sum / values.size()
+				<< ", \"min\": " << values.front()
+				<< ", \"p50\": " << percentile(50)
+				<< ", \"p90\": " << percentile(90)
+				<< ", \"p95\": " << percentile(95)
+				<< ", \"p99\": " << percentile(99)
+				<< ", \"max\": " << values.back();
+		}
+		out << "}";
+	}
+
+private:
+	double percentile(unsigned int p) {
+		return values[(values.size()-1)*p/100];
+	}
+
+	std::vector<double> values;
+};
+
+/**
+ * Sums of the statistics of one pass, written as means per frame
+ */
+class StatisticsSum {
+public:
+	StatisticsSum() : frames(0) {
+		memset(&sum, 0, sizeof(sum));
+	}
+
+	void add(const PassStatistics& statistics) {
+		sum.vertices += statistics.vertices;
+		sum.fragments += statistics.fragments;
+		sum.compute += statistics.compute;
+		sum.samples += statistics.samples;
+		sum.bytes_read += statistics.bytes_read;
+		sum.bytes_written += statistics.bytes_written;
+		++frames;
+	}
+
+	void writeJSON(std::ostream& out) {
+		const double n = std::max(frames, 1u);
+		out << "{\"vertices\": " << sum.vertices / n
+			<< ", \"fragments\": " << sum.fragments / n
+			<< ", \"compute_invocations\": " << sum.compute / n
+			<< ", \"samples_passed\": " << sum.samples / n
+			<< ", \"bytes_read\": " << sum.bytes_read / n
+			<< ", \"bytes_written\": " << sum.bytes_written / n << "}";
+	}
+
+private:
+	PassStatistics sum;
+	unsigned int frames;
+};
+
+std::vector<std::string> split(const std::string& list) {
+	std::vector<std::string> items;
+	std::stringstream ss(list);
+	std::string item;
+	while (std::getline(ss, item, ','))
+		if (!item.empty()) items.push_back(item);
+	return items;
+}
+
+RenderMode parseMode(const std::string& name) {
+	for (int mode=RenderMode::STANDARD; mode<RenderMode::RENDER_MODE_COUNT; ++mode)
+		if (name == GameManager::getRenderModeName(static_cast<RenderMode>(mode)))
+			return static_cast<RenderMode>(mode);
+	THROW_EXCEPTION("Unknown render mode " + name);
+}
+
+Antialiasing parseAntialiasing(const std::string& name) {
+	for (int mode=ANTIALIAS_NONE; mode<ANTIALIAS_COUNT; ++mode)
+		if (name == GameManager::getAntialiasingName(static_cast<Antialiasing>(mode)))
+			return static_cast<Antialiasing>(mode);
+	THROW_EXCEPTION("Unknown antialiasing " + name);
+}
+
+Config parseArguments(int argc, char* argv[]) {
+	Config config;
+	for (int i=1; i<argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--validate-blur") {
+			config.validate_blur = true;
+			continue;
+		}
+		if (arg == "--assert-zero-allocations") {
+			config.assert_zero_allocations = true;
+			continue;
+		}
+		if (i+1 >= argc) THROW_EXCEPTION("Missing value for " + arg);
+		std::string value = argv[++i];
+
+		if (arg == "--frames") config.frames = std::max(1, atoi(value.c_str()));
+		else if (arg == "--warmup") config.warmup = std::max(0, atoi(value.c_str()));
+		else if (arg == "--label") config.label = value;
+		else if (arg == "--output") config.output = value;
+		else if (arg == "--trace") config.trace = value;
+		else if (arg == "--antialiasing") config.antialiasing = parseAntialiasing(value);
+		else if (arg == "--deferred") config.deferred_lights = std::max(1, atoi(value.c_str()));
+		else if (arg == "--blur") {
+			if (value != "fragment" && value != "compute") THROW_EXCEPTION("Unknown blur " + value);
+			config.compute_blur = (value == "compute");
+		}
+		else if (arg == "--resolutions") {
+			std::vector<std::string> items = split(value);
+			for (size_t j=0; j<items.size(); ++j) {
+				unsigned int w, h;
+				if (std::sscanf(items[j].c_str(), "%ux%u", &w, &h) != 2)
+					THROW_EXCEPTION("Resolutions must be given as WIDTHxHEIGHT");
+				config.resolutions.push_back(std::make_pair(w, h));
+			}
+		}
+		else if (arg == "--downscale") {
+			std::vector<std::string> items = split(value);
+			for (size_t j=0; j<items.size(); ++j)
+				config.downscale_levels.push_back(atoi(items[j].c_str()));
+		}
+		else if (arg == "--modes") {
+			std::vector<std::string> items = split(value);
+			for (size_t j=0; j<items.size(); ++j)
+				config.modes.push_back(parseMode(items[j]));
+		}
+		else THROW_EXCEPTION("Unknown argument " + arg);
+	}
+
+	if (config.resolutions.empty()) {
+		config.resolutions.push_back(std::make_pair(800u, 600u));
+		config.resolutions.push_back(std::make_pair(1920u, 1080u));
+	}
+	if (config.downscale_levels.empty()) {
+		config.downscale_levels.push_back(2);
+		config.downscale_levels.push_back(3);
+		config.downscale_levels.push_back(4);
+	}
+	if (config.modes.empty()) {
+		for (int mode=RenderMode::STANDARD; mode<RenderMode::RENDER_MODE_COUNT; ++mode)
+			config.modes.push_back(static_cast<RenderMode>(mode));
+	}
+	return config;
+}
+
+/**
+ * Renders one configuration, and writes its results as a JSON object.
+ * Returns the number of heap allocations in the measured frames.
+ */
+uint64_t runConfiguration(GameManager& game, PassProfiler& profiler, const Config& config,
+		RenderMode mode, unsigned int width, unsigned int height, unsigned int level, std::ostream& out) {
+	game.setResolution(width, height);
+	game.setDownscaleLevel(level);
+	game.setFilterMode(mode);
+
+	CameraPath path(config.frames);
+	std::map<std::string, Samples> passes;
+	std::map<std::string, StatisticsSum> statistics;
+	Samples gpu_total, cpu_total;
+	unsigned int collected = 0;
+	PassTimings timings;
+
+	const unsigned int n_frames = config.warmup + config.frames;
+	for (unsigned int frame=0; frame<n_frames; ++frame) {
+		game.setViewRotation(path.getRotation(frame));
+
+		//Count allocations once the targets and caches have warmed up
+		const bool measured = (frame >= config.warmup);
+		if (frame == config.warmup) AllocationTracker::reset();
+
+		Timer cpu_timer;
+		AllocationTracker::setEnabled(measured);
+		{
+			AllocationScope scope("render");
+			profiler.beginFrame();
+			game.render();
+			profiler.endFrame();
+		}
+		AllocationTracker::setEnabled(false);
+		SDL_GL_SwapWindow(game.getWindow());
+		if (frame >= config.warmup) cpu_total.add(cpu_timer.elapsed()*1e3);
+
+		//Results arrive a few frames late, in order
+		bool last = (frame == n_frames-1);
+		while (profiler.collect(timings, last)) {
+			if (collected++ < config.warmup) continue;
+			gpu_total.add(timings.total);
+			for (unsigned int i=0; i<timings.n_passes; ++i) {
+				passes[timings.names[i]].add(timings.times[i]);
+				statistics[timings.names[i]].add(timings.statistics[i]);
+			}
+		}
+	}
+
+	const AllocationStats allocations = AllocationTracker::getTotal();
+	if (allocations.count > 0 && config.assert_zero_allocations)
+		AllocationTracker::report(std::cerr, config.frames);
+
+	out << "    {\"mode\": \"" << GameManager::getRenderModeName(mode) << "\""
+		<< ", \"width\": " << width << ", \"height\": " << height
+		<< ", \"downscale_level\": " << level << ",\n";
+	out << "     \"allocations_per_frame\": " << allocations.count / static_cast<double>(config.frames)
+		<< ", \"allocated_bytes_per_frame\": " << allocations.bytes / static_cast<double>(config.frames) << ",\n";
+	out << "     \"gpu_total\": ";
+	gpu_total.writeJSON(out);
+	out << ",\n     \"cpu_total\": ";
+	cpu_total.writeJSON(out);
+	out << ",\n     \"passes\": {";
+	for (std::map<std::string, Samples>::iterator it=passes.begin(); it!=passes.end(); ++it) {
+		if (it != passes.begin()) out << ",";
+		out << "\n       \"" << it->first << "\": ";
+		it->second.writeJSON(out);
+	}
+	out << "},\n     \"pass_statistics\": {";
+	for (std::map<std::string, StatisticsSum>::iterator it=statistics.begin(); it!=statistics.end(); ++it) {
+		if (it != statistics.begin()) out << ",";
+		out << "\n       \"" << it->first << "\": ";
+		it->second.writeJSON(out);
+	}
+	out << "}}";
+	return allocations.count;
+}
+
+/**
+ * Runs the blur validation, and checks each case against its own bound
+ * on the error relative to the [0, 1] test image.
+ *
+ * The recursive Gaussian must match its reference closely. Its third
+ * order fit is least accurate at sigma 1, where the hard edges of the
+ * test image give a few pixels a larger error, so there only the RMS
+ * error gets the tight bound. Three boxes only approximate a Gaussian,
+ * and odd box widths cannot hit sigma 1 exactly, so the box cascade
+ * gets the loose bound.
+ */
+bool validateBlur() {
+	const double tight = 1e-2;
+	const double loose = 1e-1;
+
+	const std::vector<RecursiveBlur::ValidationResult> results = RecursiveBlur::validate();
+	bool passed = true;
+	for (size_t i=0; i<results.size(); ++i) {
+		const RecursiveBlur::ValidationResult& result = results[i];
+		double max_bound = loose;
+		double rms_bound = loose;
+		if (std::strcmp(result.filter, "recursive") == 0) {
+			max_bound = (result.sigma > 1.0f) ? 1.5*tight : 5.0*tight;
+			rms_bound = tight;
+		}
+		if (result.max_error > max_bound || result.rms_error > rms_bound) {
+			std::cerr << "The " << result.filter << " blur at sigma " << result.sigma << " is off by up to "
+				<< result.max_error << " (RMS " << result.rms_error << "), more than " << max_bound
+				<< " (RMS " << rms_bound << ")" << std::endl;
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+} //namespace
+
+int main(int argc, char *argv[]) {
+	try {
+		Config config = parseArguments(argc, argv);
+		if (config.validate_blur)
+			return validateBlur() ? 0 : 1;
+
+		if (!config.trace.empty()) {
+			Tracer::setThreadName("main");
+			Tracer::setEnabled(true);
+		}
+
+		GameManager game;
+		game.setAntialiasing(config.antialiasing);
+		game.setComputeBlur(config.compute_blur);
+		game.init(true);
+		SDL_GL_SetSwapInterval(0); //Never wait for vsync
+		if (config.deferred_lights > 0)
+			game.setDeferredShading(true, config.deferred_lights);
+		std::shared_ptr<PassProfiler> profiler(new PassProfiler());
+		game.setProfiler(profiler);
+
+		std::stringstream out;
+		out << "{\n  \"label\": \"" << config.label << "\",\n"
+			<< "  \"renderer\": \"" << glGetString(GL_RENDERER) << "\",\n"
+			<< "  \"frames\": " << config.frames << ",\n"
+			<< "  \"warmup\": " << config.warmup << ",\n"
+			<< "  \"antialiasing\": \"" << GameManager::getAntialiasingName(game.getAntialiasing()) << "\",\n"
+			<< "  \"blur\": \"" << (game.getComputeBlur() ? "compute" : "fragment") << "\",\n"
+			<< "  \"deferred_lights\": " << config.deferred_lights << ",\n"
+			<< "  \"pipeline_statistics\": " << (profiler->hasPipelineStatistics() ? "true" : "false") << ",\n"
+			<< "  \"runs\": [\n";
+
+		bool first = true;
+		uint64_t allocations = 0;
+		for (size_t m=0; m<config.modes.size(); ++m) {
+			for (size_t r=0; r<config.resolutions.size(); ++r) {
+				for (size_t d=0; d<config.downscale_levels.size(); ++d) {
+					if (!first) out << ",\n";
+					first = false;
+					std::cerr << "Benchmarking " << GameManager::getRenderModeName(config.modes[m])
+						<< " at " << config.resolutions[r].first << "x" << config.resolutions[r].second
+						<< ", downscale level " << config.downscale_levels[d] << std::endl;
+					allocations += runConfiguration(game, *profiler, config, config.modes[m],
+						config.resolutions[r].first, config.resolutions[r].second,
+						config.downscale_levels[d], out);
+				}
+			}
+		}
+		out << "\n  ],\n  \"gpu_memory_peak_bytes\": " << ResourceRegistry::getPeakBytes() << "\n}\n";
+
+		game.setProfiler(std::shared_ptr<PassProfiler>());
+		profiler.reset();
+
+		if (config.output.empty()) {
+			std::cout << out.str();
+		}
+		else {
+			std::ofstream file(config.output.c_str());
+			file << out.str();
+		}
+
+		if (!config.trace.empty()) Tracer::write(config.trace);
+
+		if (config.assert_zero_allocations && allocations > 0) {
+			std::cerr << "render() allocated " << allocations << " times in steady state" << std::endl;
+			return 1;
+		}
+	}
+	catch (std::exception& e) {
+		std::cerr << "Benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,63 @@
+#ifndef _ALLOCATIONTRACKER_H_
+#define _ALLOCATIONTRACKER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+struct AllocationStats {
+	uint64_t count; //< Number of calls to operator new
+	uint64_t bytes; //< Bytes requested
+};
+
+/**
+ * Counts heap allocations through replacements of the global
+ * operator new, to find allocations in the frame loop.
+ *
+ * Counting is per thread and off until enabled, so the render thread
+ * can measure its own frames while other threads allocate freely.
+ * Allocations are attributed to the innermost AllocationScope of the
+ * thread. Scope names must be string literals (or otherwise outlive
+ * the tracker), as they are compared by address.
+ */
+class AllocationTracker {
+public:
+	/**
+	 * Starts or stops counting allocations made by the calling thread
+	 */
+	static void setEnabled(bool enabled);
+	static bool isEnabled();
+
+	/**
+	 * Allocations counted on the calling thread since the last reset
+	 */
+	static AllocationStats getTotal();
+	static void reset();
+
+	/**
+	 * Writes the totals and the allocations per scope, divided
+	 * by the given number of frames
+	 */
+	static void report(std::ostream& out, unsigned int frames=1);
+
+	/**
+	 * Called by operator new
+	 */
+	static void record(size_t bytes);
+
+	static const unsigned int max_scopes = 32; //< Scopes beyond this only count towards the total
+};
+
+/**
+ * Attributes the allocations of the calling thread to name
+ * while in scope
+ */
+class AllocationScope {
+public:
+	AllocationScope(const char* name);
+	~AllocationScope();
+private:
+	const char* previous;
+};
+
+#endif // _ALLOCATIONTRACKER_H_
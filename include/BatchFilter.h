@@ -0,0 +1,124 @@
+#ifndef _BATCHFILTER_H_
+#define _BATCHFILTER_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include "TextureFBO.h"
+#include "BoundedQueue.h"
+
+/**
+ * Streams a directory of images through the GPU filters.
+ *
+ * Decoder threads read the images into a bounded queue, the OpenGL
+ * thread uploads them through a ring of pixel unpack buffers, filters
+ * them, and reads the result back asynchronously into a ring of pixel
+ * pack buffers, like FrameCapture. Finished reads go through a second
+ * bounded queue to encoder threads that write PNGs. The bounded queues
+ * let each stage run ahead of the next by a few images, so decoding,
+ * GPU work and encoding overlap without unbounded memory use.
+ *
+ * Binary PGM and PPM files (.pgm, .ppm, .pnm) are read; other files
+ * in the directory are ignored.
+ */
+class BatchFilter {
+public:
+	/**
+	 * Starts decoding the images in input_dir. Results are written to
+	 * output_dir/<name>.png. With workers=0, half of the hardware
+	 * threads decode, and the other half encode.
+	 */
+	BatchFilter(const std::string& input_dir, const std::string& output_dir, unsigned int workers=0);
+
+	/**
+	 * Calls finish()
+	 */
+	~BatchFilter();
+
+	/**
+	 * Waits for the next decoded image, and returns its size, or
+	 * false when every image has been handed out
+	 */
+	bool next(unsigned int& width, unsigned int& height);
+
+	/**
+	 * Uploads the image returned by next() into target, which
+	 * must have its size
+	 */
+	void upload(TextureFBO& target);
+
+	/**
+	 * Starts an asynchronous read of source as the result for the
+	 * image returned by next(), and hands every completed read to
+	 * the encoders
+	 */
+	void readback(TextureFBO& source);
+
+	/**
+	 * Waits for every read and write, and prints the throughput
+	 */
+	void finish();
+
+	unsigned int getImageCount() { return static_cast<unsigned int>(inputs.size()); }
+	unsigned int getImagesWritten() { return images_written; }
+	unsigned int getImagesFailed() { return images_failed; }
+
+private:
+	static const unsigned int ring_size = 3; //< Images in flight on the GPU, per direction
+	static const unsigned int queue_size = 4; //< Images waiting between the stages
+
+	struct Image {
+		std::string name; //< Output file
+		unsigned int width, height;
+		std::vector<unsigned char> pixels; //< RGBA, top row first
+	};
+
+	void decoderLoop();
+	void encoderLoop();
+
+	/**
+	 * Maps the oldest pack buffer and queues its pixels for the
+	 * encoders. If block is false, returns false instead of
+	 * waiting when the GPU has not finished the read yet.
+	 */
+	bool retire(bool block);
+
+	/**
+	 * Makes buffer at least bytes large
+	 */
+	static void reserve(GLenum target, GLuint buffer, size_t& capacity, size_t bytes, GLenum usage);
+
+	std::vector<std::string> inputs;
+	std::string output_dir;
+
+	std::atomic<unsigned int> next_input; //< Next file for a decoder to claim
+	std::atomic<unsigned int> decoders_running; //< The last one to stop closes decoded
+	BoundedQueue<Image> decoded; //< Decoders to the OpenGL thread
+	BoundedQueue<Image> encoded; //< OpenGL thread to the encoders
+	std::vector<std::thread> decoders, encoders;
+
+	Image current; //< Image being filtered
+
+	GLuint upload_pbos[ring_size];
+	size_t upload_capacity[ring_size];
+	GLsync upload_fences[ring_size];
+	unsigned int upload_head; //< Next unpack buffer to fill
+
+	GLuint readback_pbos[ring_size];
+	size_t readback_capacity[ring_size];
+	GLsync readback_fences[ring_size];
+	Image pending[ring_size]; //< Name and size of the image each pack buffer holds
+	unsigned int readback_head; //< Next pack buffer to read into
+	unsigned int in_flight; //< Number of pack buffers with a pending read
+
+	std::atomic<unsigned int> images_written, images_failed;
+	std::chrono::steady_clock::time_point start;
+	bool finished;
+};
+
+#endif // _BATCHFILTER_H_
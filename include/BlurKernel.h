@@ -0,0 +1,15 @@
+#ifndef _BLURKERNEL_H_
+#define _BLURKERNEL_H_
+
+/**
+ * The separable Gaussian (sigma 1) of horizontal_blur.frag,
+ * vertical_blur.frag and separable_blur.comp. A blur of a region
+ * reads radius texels past its edges, so passes that only update
+ * part of a target extend it by that much.
+ */
+class BlurKernel {
+public:
+	static const unsigned int radius = 5; //< Taps on each side of the centre
+};
+
+#endif // _BLURKERNEL_H_
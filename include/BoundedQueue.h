@@ -0,0 +1,67 @@
+#ifndef _BOUNDEDQUEUE_H_
+#define _BOUNDEDQUEUE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/**
+ * Blocking queue between pipeline stages, for any number of
+ * producers and consumers. push() waits while the queue is full,
+ * so a slow stage holds back the ones before it instead of letting
+ * memory grow.
+ *
+ * close() wakes every waiting thread; after it, push() fails, and
+ * pop() fails once the queue is drained.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+	/**
+	 * Returns false if the queue was closed
+	 */
+	bool push(T item) {
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this] { return items.size() < capacity || closed; });
+		if (closed) return false;
+		items.push_back(std::move(item));
+		lock.unlock();
+		not_empty.notify_one();
+		return true;
+	}
+
+	/**
+	 * Returns false once the queue is closed and drained
+	 */
+	bool pop(T& item) {
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [this] { return !items.empty() || closed; });
+		if (items.empty()) return false;
+		item = std::move(items.front());
+		items.pop_front();
+		lock.unlock();
+		not_full.notify_one();
+		return true;
+	}
+
+	void close() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+		not_full.notify_all();
+		not_empty.notify_all();
+	}
+
+private:
+	std::deque<T> items;
+	const size_t capacity;
+	bool closed;
+	std::mutex mutex;
+	std::condition_variable not_full, not_empty;
+};
+
+#endif // _BOUNDEDQUEUE_H_
@@ -0,0 +1,99 @@
+#ifndef _FRAMECAPTURE_H_
+#define _FRAMECAPTURE_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <atomic>
+
+#include <GL/glew.h>
+
+#include "TextureFBO.h"
+#include "ImageIO.h"
+
+enum CaptureFormat { CAPTURE_Y4M, CAPTURE_PNG };
+
+/**
+ * Records the contents of a TextureFBO without stalling the GPU.
+ *
+ * Each captured frame is read into one of a ring of pixel pack
+ * buffers with an asynchronous glReadPixels, and a fence is inserted
+ * after it. The buffer is only mapped a few frames later, once its
+ * fence has signalled, and the pixels are handed to a writer thread
+ * that encodes them to disk. If the writer falls behind, frames are
+ * dropped instead of blocking the render loop.
+ */
+class FrameCapture {
+public:
+	/**
+	 * For CAPTURE_Y4M, path is the video file. For CAPTURE_PNG, path is
+	 * a prefix, and frames are written to <path>_000000.png etc.
+	 */
+	FrameCapture(unsigned int width, unsigned int height, CaptureFormat format,
+			std::string path, unsigned int fps=60);
+
+	/**
+	 * Waits for all frames in flight, and flushes them to disk
+	 */
+	~FrameCapture();
+
+	/**
+	 * Starts an asynchronous read of source, and retires the
+	 * oldest frames whose reads have completed. Frames of a
+	 * different size than the capture are dropped.
+	 */
+	void capture(TextureFBO& source);
+
+	unsigned int getWidth() { return width; }
+	unsigned int getHeight() { return height; }
+	unsigned int getFramesWritten() { return frames_written; }
+	unsigned int getFramesDropped() { return frames_dropped; }
+
+private:
+	static const unsigned int ring_size = 3; //< Frames in flight on the GPU
+	static const unsigned int max_queued = 8; //< Frames waiting for the writer
+
+	/**
+	 * Maps the oldest PBO in the ring and queues its pixels for
+	 * the writer. If block is false, returns false instead of
+	 * waiting when the GPU has not finished the read yet.
+	 */
+	bool retire(bool block);
+
+	void writerLoop();
+
+	unsigned int width, height;
+	CaptureFormat format;
+	std::string path;
+	std::unique_ptr<Y4MWriter> y4m;
+
+	GLuint pbos[ring_size];
+	GLsync fences[ring_size];
+	unsigned int head; //< Next PBO to read into
+	unsigned int in_flight; //< Number of PBOs with a pending read
+
+	struct Frame {
+		unsigned int index;
+		std::vector<unsigned char> pixels;
+	};
+
+	//Ring of frames waiting for the writer. The pixel buffers are
+	//allocated once, and the render thread only fills the slot after
+	//the last queued one, so the writer can encode without the lock.
+	Frame queue[max_queued];
+	unsigned int queue_head, queue_count;
+
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable queue_changed;
+	bool stopping;
+
+	unsigned int frames_captured;
+	std::atomic<unsigned int> frames_written;
+	unsigned int frames_dropped;
+};
+
+#endif // _FRAMECAPTURE_H_
@@ -0,0 +1,85 @@
+#ifndef _FRAMESCHEDULER_H_
+#define _FRAMESCHEDULER_H_
+
+#include <cstdint>
+
+#include "Timer.h"
+
+enum SchedulerMode { CONTINUOUS, VSYNC_LOCKED, FIXED_RATE, ON_DEMAND };
+
+/**
+ * Frame-time statistics over the most recent frames, in milliseconds
+ */
+struct FrameStats {
+	FrameStats() : frames(0), last(0), mean(0), min(0), max(0), p50(0), p95(0), p99(0) {}
+	uint64_t frames; //< Total number of frames rendered
+	double last, mean, min, max;
+	double p50, p95, p99;
+};
+
+/**
+ * Decides when the main loop should render a new frame, and
+ * how long it may block waiting for events in between.
+ *
+ * CONTINUOUS renders as fast as possible, VSYNC_LOCKED renders
+ * every iteration and lets the buffer swap pace us, FIXED_RATE
+ * sleeps until the next frame deadline, and ON_DEMAND only
+ * renders after requestRedraw() has been called.
+ */
+class FrameScheduler {
+public:
+	FrameScheduler(SchedulerMode mode=ON_DEMAND, double target_fps=60.0);
+	~FrameScheduler();
+
+	/**
+	 * Changes the scheduling mode. Returns the swap interval
+	 * that should be set on the GL context for this mode.
+	 */
+	int setMode(SchedulerMode mode);
+	SchedulerMode getMode() const { return mode; }
+	static const char* getModeName(SchedulerMode mode);
+
+	void setTargetRate(double fps);
+
+	/**
+	 * Marks the current frame as stale, so that ON_DEMAND
+	 * renders on the next iteration
+	 */
+	inline void requestRedraw() { redraw_requested = true; }
+
+	/**
+	 * Returns how long the main loop may block waiting for events
+	 * in milliseconds: -1 means indefinitely, 0 means do not block.
+	 */
+	int getWaitTimeout() const;
+
+	/**
+	 * Returns true if a frame should be rendered now
+	 */
+	bool shouldRender() const;
+
+	/**
+	 * Call around render() and the buffer swap
+	 */
+	void beginFrame();
+	void endFrame();
+
+	/**
+	 * Computes statistics over the recorded frame times
+	 */
+	FrameStats getStats() const;
+
+private:
+	static const unsigned int history_size = 256;
+
+	SchedulerMode mode;
+	uint64_t frame_period; //< Nanoseconds between frames in FIXED_RATE
+	uint64_t next_deadline; //< Time of the next frame in FIXED_RATE
+	uint64_t frame_begin;
+	bool redraw_requested;
+
+	uint64_t frame_times[history_size]; //< Ring buffer of frame times in nanoseconds
+	uint64_t frame_count;
+};
+
+#endif // _FRAMESCHEDULER_H_
@@ -1,8 +1,12 @@
 #ifndef _BO_HPP__
 #define _BO_HPP__
 
+#include <algorithm>
+
 #include <GL/glew.h>
 
+#include "ResourceRegistry.h"
+
 namespace GLUtils {
 
 template <GLenum T>
@@ -13,10 +17,31 @@ public:
 		bind();
 		glBufferData(T, bytes, data, usage);
 		unbind();
+		ResourceRegistry::add(RESOURCE_BUFFER, vbo_name, bytes);
+		this->usage = usage;
+		capacity = bytes;
+	}
+
+	/**
+	 * Replaces the first bytes of the contents. The old storage is
+	 * orphaned, so this does not wait for draws using it. The
+	 * capacity only grows, so a buffer sized for the largest update
+	 * up front keeps its size.
+	 */
+	void update(const void* data, unsigned int bytes) {
+		bind();
+		if (bytes > capacity) {
+			capacity = std::max(bytes, 2*capacity);
+			ResourceRegistry::resize(RESOURCE_BUFFER, vbo_name, capacity);
+		}
+		glBufferData(T, capacity, NULL, usage);
+		glBufferSubData(T, 0, bytes, data);
+		unbind();
 	}
 
 	~BO() {
 		unbind();
+		ResourceRegistry::remove(RESOURCE_BUFFER, vbo_name);
 		glDeleteBuffers(1, &vbo_name);
 	}
 
@@ -34,7 +59,11 @@ public:
 
 private:
 	BO() {}
+	BO(const BO&); //< Not copyable, the copy would delete the buffer twice
+	BO& operator=(const BO&);
 	GLuint vbo_name; //< VBO name
+	int usage;
+	unsigned int capacity; //< Bytes of storage
 };
 
 };//namespace GLUtils
@@ -28,6 +28,19 @@ inline void checkGLErrors(const char* file, unsigned int line) {
     } 
 }
 
+/**
+ * Blocks until the fence is signaled. A timeout only means the GPU is
+ * busy, so the wait is repeated rather than taken as the fence passing
+ */
+inline void waitSync(GLsync fence) {
+	GLenum status;
+	do {
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+	} while (status == GL_TIMEOUT_EXPIRED);
+	if (status == GL_WAIT_FAILED)
+		THROW_EXCEPTION("Waiting for the fence failed");
+}
+
 
 }; //Namespace GLUtils
 
@@ -2,6 +2,7 @@
 #define _PROGRAM_HPP__
 
 #include "GameException.h"
+#include "ResourceRegistry.h"
 
 #include <string>
 #include <sstream>
@@ -50,26 +51,58 @@ inline std::string readFile(std::string file) {
 class Program {
 public:
 	Program(std::string vs, std::string fs) {
-		name = glCreateProgram();
+		create();
+		try {
+			std::string vs_src = readFile(vs);
+			std::string fs_src = readFile(fs);
+
+			attachShader(vs_src, GL_VERTEX_SHADER);
+			attachShader(fs_src, GL_FRAGMENT_SHADER);
+			link();
+		}
+		catch (...) {
+			destroy();
+			throw;
+		}
+	}
 
-		std::string vs_src = readFile(vs);
-		std::string fs_src = readFile(fs);
+	Program(std::string vs, std::string gs, std::string fs) {
+		create();
+		try {
+			std::string vs_src = readFile(vs);
+			std::string gs_src = readFile(gs);
+			std::string fs_src = readFile(fs);
+
+			attachShader(vs_src, GL_VERTEX_SHADER);
+			attachShader(gs_src, GL_GEOMETRY_SHADER);
+			attachShader(fs_src, GL_FRAGMENT_SHADER);
+			link();
+		}
+		catch (...) {
+			destroy();
+			throw;
+		}
+	}
 
-		attachShader(vs_src, GL_VERTEX_SHADER);
-		attachShader(fs_src, GL_FRAGMENT_SHADER);
-		link();
+	/**
+	 * Compute program, requires OpenGL 4.3
+	 */
+	explicit Program(std::string cs) {
+		create();
+		try {
+			std::string cs_src = readFile(cs);
+
+			attachShader(cs_src, GL_COMPUTE_SHADER);
+			link();
+		}
+		catch (...) {
+			destroy();
+			throw;
+		}
 	}
 
-	Program(std::string vs, std::string gs, std::string fs) {
-		name = glCreateProgram();
-		std::string vs_src = readFile(vs);
-		std::string gs_src = readFile(gs);
-		std::string fs_src = readFile(fs);
-		
-		attachShader(vs_src, GL_VERTEX_SHADER);
-		attachShader(gs_src, GL_GEOMETRY_SHADER);
-		attachShader(fs_src, GL_FRAGMENT_SHADER);
-		link();
+	~Program() {
+		destroy();
 	}
 
 	inline void use() {
@@ -80,12 +113,20 @@ public:
 		glUseProgram(0);
 	}
 
-	inline GLint getUniform(std::string var) {
-		GLint loc = glGetUniformLocation(name, var.c_str());
+	inline GLuint getName() {
+		return name;
+	}
+
+	inline GLint getUniform(const char* var) {
+		GLint loc = glGetUniformLocation(name, var);
 		assert(loc >= 0);
 		return loc;
 	}
 
+	inline GLint getUniform(const std::string& var) {
+		return getUniform(var.c_str());
+	}
+
 	inline void setAttributePointer(std::string var, unsigned int size, GLenum type=GL_FLOAT, GLboolean normalized=GL_FALSE, GLsizei stride=0, GLvoid* pointer=NULL) {
 		GLint loc = glGetAttribLocation(name, var.c_str());
 		assert(loc >= 0);
@@ -94,9 +135,40 @@ public:
 	}
 
 private:
+	Program(const Program&); //< Not copyable, the copy would delete the program twice
+	Program& operator=(const Program&);
+
+	void create() {
+		name = glCreateProgram();
+		ResourceRegistry::add(RESOURCE_PROGRAM, name, 0);
+	}
+
+	/**
+	 * Deletes the shaders that are still attached, and the program
+	 */
+	void destroy() {
+		deleteShaders();
+		ResourceRegistry::remove(RESOURCE_PROGRAM, name);
+		glDeleteProgram(name);
+	}
+
+	/**
+	 * The linked program keeps its own copy of the code,
+	 * so the shader objects are not needed afterwards
+	 */
+	void deleteShaders() {
+		for (unsigned int i=0; i<shaders.size(); ++i) {
+			glDetachShader(name, shaders[i]);
+			ResourceRegistry::remove(RESOURCE_SHADER, shaders[i]);
+			glDeleteShader(shaders[i]);
+		}
+		shaders.clear();
+	}
+
 	void link() {
 		std::stringstream log;
 		glLinkProgram(name);
+		deleteShaders();
 
 		// check for errors
 		GLint linkstatus;
@@ -133,6 +205,11 @@ private:
 		glShaderSource(s, 1, src_list, NULL);
 		glCompileShader(s);
 
+		//Keep track of the shader from here, so it is deleted if compilation fails
+		glAttachShader(name, s);
+		shaders.push_back(s);
+		ResourceRegistry::add(RESOURCE_SHADER, s, src.size());
+
 		// check for errors
 		GLint compile_status;
 		glGetShaderiv(s, GL_COMPILE_STATUS, &compile_status);
@@ -160,11 +237,10 @@ private:
 			}
 			THROW_EXCEPTION(log.str());
 		}
-		
-		glAttachShader(name, s);
 	}
 
 	GLuint name; //< OpenGL shader program
+	std::vector<GLuint> shaders; //< Shaders attached until the program is linked
 
 };
 
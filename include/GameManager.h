@@ -3,19 +3,59 @@
 
 #include <tuple>
 #include <vector>
+#include <string>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
 
 #include <GL/glew.h>
 #include <SDL.h>
 #include <glm/glm.hpp>
 
 #include "Timer.h"
+#include "FrameScheduler.h"
 #include "GLUtils/GLUtils.hpp"
 #include "Model.h"
 #include "VirtualTrackball.h"
 #include "TextureFBO.h"
+#include "TextureFBO3D.h"
+#include "PassCache.h"
+#include "FrameCapture.h"
+#include "PassProfiler.h"
+#include "TargetPool.h"
+#include "ResolutionController.h"
+#include "InputEvent.h"
+#include "InputTrace.h"
+#include "AllocationTracker.h"
+#include "RecursiveBlur.h"
+#include "BatchFilter.h"
+#include "TiledFilter.h"
+#include "LightClusters.h"
+#include "SummedAreaTable.h"
 
-enum RenderMode { STANDARD, BLUR, GREYSCALE, COMBO };
+enum RenderMode {
+	STANDARD, BLUR, GREYSCALE, COMBO,
+	RECURSIVE_BLUR, //< Recursive Gaussian at the scene resolution, needs compute shaders
+	BOX_BLUR, //< Box filter cascade at the scene resolution, needs compute shaders
+	BILATERAL, //< Edge preserving blur through a bilateral grid
+	TONEMAP, //< Auto exposure from a luminance histogram, and tone mapping
+	TEMPORAL_BLUR, //< Downscaled blur reusing the last frame's result, reprojected
+	SPLIT_VIEW, //< Standard, blur, greyscale and combo, each in a quarter of the screen
+	DEPTH_OF_FIELD, //< Blur growing with the distance from the focus plane, gathered at a lower resolution
+	BLOOM, //< Glow around the bright surfaces, added while presenting
+	VARIABLE_BLUR, //< Box blur with a radius from the depth, through a summed-area table, needs compute shaders
+	RENDER_MODE_COUNT
+};
+
+enum Antialiasing {
+	ANTIALIAS_NONE,
+	ANTIALIAS_MSAA, //< Multisampled scene target, resolved before the filters
+	ANTIALIAS_FXAA, //< Blur along the edges of the scene, in one full screen pass
+	ANTIALIAS_COUNT
+};
 /**
  * This class handles the game logic and display.
  * Uses SDL as the display manager, and glm for 
@@ -36,12 +76,14 @@ public:
 
 	/**
 	 * Initializes the game, including the OpenGL context
-	 * and data required
+	 * and data required. A hidden window is used for
+	 * headless rendering, e.g., when benchmarking.
 	 */
-	void init();
+	void init(bool hidden=false);
 
 	/**
-	 * The main loop of the game. Runs the SDL main loop
+	 * The main loop of the game. Runs the SDL main loop on the
+	 * calling thread, and renders on a separate render thread
 	 */
 	void play();
 
@@ -55,11 +97,95 @@ public:
 	 */
 	void render();
 
+	/**
+	 * Changes the output resolution, and reallocates every
+	 * target that depends on it
+	 */
+	void setResolution(unsigned int width, unsigned int height);
+
+	/**
+	 * Sets how many times (as a power of two) the blur
+	 * target is downscaled
+	 */
+	void setDownscaleLevel(unsigned int level);
+
+	/**
+	 * Sets how many times (as a power of two) the depth
+	 * of field is downscaled while it is gathered
+	 */
+	void setDepthOfFieldLevel(unsigned int level);
+
+	/**
+	 * Switches the antialiasing of the scene, and prints the memory
+	 * it takes. The time it takes shows in the profiler.
+	 */
+	void setAntialiasing(Antialiasing mode);
+	Antialiasing getAntialiasing() { return antialiasing; }
+	static const char* getAntialiasingName(Antialiasing mode);
+
+	/**
+	 * Runs the two passes of the downscaled blur in compute shaders
+	 * with shared memory, or in the fragment shaders. Compute needs
+	 * OpenGL 4.3.
+	 */
+	void setComputeBlur(bool enable);
+	bool getComputeBlur() { return compute_blur; }
+
+	/**
+	 * Switches between forward shading with one light, and deferred
+	 * shading with many
+	 */
+	void setDeferredShading(bool enable, unsigned int lights);
+
+	void setFilterMode(RenderMode mode);
+	RenderMode getFilterMode() { return filterMode; }
+	static const char* getRenderModeName(RenderMode mode);
+
+	/**
+	 * Overrides the camera rotation normally set by the trackball
+	 */
+	void setViewRotation(const glm::mat4& rotation);
+
+	/**
+	 * Sets a profiler that times each pass of render(), or NULL
+	 */
+	void setProfiler(std::shared_ptr<PassProfiler> profiler) { this->profiler = profiler; }
+
+	/**
+	 * Records the input applied before each frame, and writes it
+	 * to filename when the game exits. Call before play().
+	 */
+	void setInputRecording(const std::string& filename);
+
+	/**
+	 * Replays a recorded trace instead of live input, rendering every
+	 * frame with a fixed timestep, and exits at the end of the trace.
+	 * Call before init().
+	 */
+	void setInputReplay(const std::string& filename);
+
+	/**
+	 * Applies the blur, greyscale or combo filter to every image in
+	 * input_dir, and writes the results to output_dir. Call after
+	 * init() instead of play().
+	 */
+	void filterImages(const std::string& input_dir, const std::string& output_dir, RenderMode mode);
+
+	/**
+	 * Applies the blur, greyscale or combo filter to a PGM/PPM of any
+	 * size, in tiles of at most tile_size, and writes a PPM. Call
+	 * after init() instead of play().
+	 */
+	void filterLargeImage(const std::string& input_file, const std::string& output_file, RenderMode mode,
+			unsigned int tile_size=2048);
+
+	SDL_Window* getWindow() { return main_window; }
+
 protected:
 	/**
 	 * Creates the OpenGL context using SDL
 	 */
-	void createOpenGLContext();
+	void createOpenGLContext(bool hidden);
 
 	/**
 	 * Sets states for OpenGL that we want to keep persistent
@@ -68,8 +194,7 @@ protected:
 	void setOpenGLStates();
 
 	/**
-	 * Creates the matrices for the OpenGL transformations,
-	 * perspective, etc.
+	 * Creates the matrices for the OpenGL transformations
 	 */
 	void createMatrices();
 
@@ -89,24 +214,267 @@ protected:
 	  */
 	void createFBO();
 
-	static const unsigned int window_width = 800;
-	static const unsigned int window_height = 600;
+	/**
+	  * Creates the luminance histogram and the adapted luminance
+	  * used for auto exposure
+	  */
+	void createExposure();
+
+	/**
+	  * Reallocates every target that depends on the window size,
+	  * after the size has changed
+	  */
+	void resizeTargets();
+
+	/**
+	  * Sets the projection and texel size uniforms that
+	  * depend on the output and target sizes
+	  */
+	void setSizeDependentUniforms();
+
+	/**
+	  * Switches the frame scheduler mode, and sets the
+	  * matching swap interval on the context
+	  */
+	void setSchedulerMode(SchedulerMode mode);
+
+	/**
+	  * Starts capturing the filtered output to disk, or stops
+	  * an ongoing capture
+	  */
+	void toggleCapture(CaptureFormat format);
+
+	/**
+	  * Turns dynamic resolution scaling on or off
+	  */
+	void toggleDynamicResolution();
+
+	/**
+	  * Starts counting the heap allocations made by render(), or
+	  * stops and reports them per frame and per pass
+	  */
+	void toggleAllocationTracking();
+
+	/**
+	  * Sets the scene target size relative to the window, and the
+	  * blur downscale level relative to the scene target
+	  */
+	void setRenderScale(float scale, unsigned int level);
+
+	/**
+	  * Body of the render thread: handles queued input and
+	  * renders frames until the game exits
+	  */
+	void renderLoop();
+
+	/**
+	  * Converts an SDL event into an InputEvent. Returns false
+	  * for events the renderer does not care about.
+	  */
+	static bool translateEvent(const SDL_Event& event, InputEvent& input);
+
+	/**
+	  * Applies one input event on the render thread
+	  */
+	void handleInput(const InputEvent& event, bool& doExit);
+	void handleKey(int key, unsigned int mod, bool& doExit);
+
+	unsigned int window_width;
+	unsigned int window_height;
+	unsigned int max_target_size; //< Largest texture and viewport the GL supports
+	bool compute_supported; //< The context is OpenGL 4.3 or newer
+	unsigned int msaa_samples; //< Of the multisampled scene target, limited by the GL
+	bool compute_blur; //< Run the downscaled blur in separable_blur_program
+
+	static const unsigned int resize_debounce_ms = 150; //< Wait this long after the last resize event
+	bool resize_pending; //< The window size changed, but the targets have the old size
+	uint64_t resize_deadline; //< When to reallocate the targets
 
 private:
-	static void renderMeshRecursive(MeshPart& mesh, const std::shared_ptr<GLUtils::Program>& program, const glm::mat4& modelview, const glm::mat4& transform);
+	/**
+	  * Renders a screen covering quad into target with the given
+	  * program, sampling source on texture_unit
+	  */
+	void renderFullscreenPass(GLUtils::Program& program, TextureFBO& source, GLenum texture_unit, TextureFBO& target);
 
-	static const unsigned int max_vaos = 2;
-	GLuint vaos[max_vaos]; //< Vertex array object
+	/**
+	  * Adds estimated memory traffic to the pass being profiled
+	  */
+	void addTraffic(uint64_t bytes_read, uint64_t bytes_written) {
+		if (profiler) profiler->addTraffic(static_cast<uint64_t>(bytes_read*pass_coverage), static_cast<uint64_t>(bytes_written*pass_coverage));
+	}
+
+	/**
+	  * Blurs source into target (of the same size) with compute shaders,
+	  * in time independent of sigma
+	  */
+	void renderRecursiveBlur(TextureFBO& source, TextureFBO& target, float sigma);
+	void renderBoxBlur(TextureFBO& source, TextureFBO& target, float sigma);
+
+	/**
+	  * One direction of the downscaled blur with a compute shader, from
+	  * the mipmap level of source that has the size of target
+	  */
+	void renderSeparableBlur(TextureFBO& source, unsigned int level, TextureFBO& target, bool horizontal);
+
+	/**
+	  * Builds the summed-area table of source with two prefix scans, of
+	  * the rows and then of the columns, and blurs source into target
+	  * with a box whose radius grows with the distance from the focus
+	  */
+	void renderVariableBlur(TextureFBO& source, TextureFBO& target);
+
+	/**
+	  * Edge preserving blur of source into target: splats the pixels into
+	  * a coarse grid over position and luminance, blurs the grid, and
+	  * slices it at every pixel
+	  */
+	void renderBilateralGrid(TextureFBO& source, TextureFBO& target);
+
+	/**
+	  * Meters the luminance of source on the GPU, and updates the adapted
+	  * luminance in exposure_fbo, without reading anything back
+	  */
+	void renderMetering(TextureFBO& source);
+
+	/**
+	  * Finishes the downscaled blur in fbo2 into blur_fbo, reprojecting the
+	  * last result to the new view and blurring only some tiles afresh
+	  */
+	void renderTemporalBlur(const glm::mat4& view);
+
+	/**
+	  * Composes the standard, blur, greyscale and combo filters of scene
+	  * into the quarters of blur_fbo, running each filter only on its own
+	  * quarter. The blur is shared, as combo is the greyscale of it.
+	  */
+	void renderSplitView(TextureFBO& scene);
+
+	/**
+	  * Renders depth of field into blur_fbo, focused on the middle of the
+	  * screen. The circle of confusion comes from the depth of fbo1, the
+	  * blur is gathered at 2^-dof_downscale_level of the scene resolution,
+	  * and upsampled again with weights that keep it from crossing edges.
+	  */
+	void renderDepthOfField(TextureFBO& scene);
+
+	/**
+	  * Builds the bloom pyramid in bloom_fbos: a bright pass of scene at
+	  * half resolution, downsampled level by level, and upsampled back
+	  * with each level added onto the next larger one
+	  */
+	void renderBloom(TextureFBO& scene);
+
+	/**
+	  * Runs the blur, greyscale or combo filter on an uploaded image
+	  * at its full resolution
+	  */
+	void renderImageFilter(RenderMode mode, TextureFBO& input, TextureFBO& scratch, TextureFBO& result);
+
+	/**
+	  * Places the point lights of the deferred path around the model
+	  */
+	void createLights();
+
+	/**
+	  * Renders the scene into fbo1 with deferred shading: the G-buffer,
+	  * light culling into clusters on the CPU, and one lighting pass
+	  */
+	void renderDeferred(const glm::mat4& view);
+
+	/**
+	  * Limits the following passes to a rectangle of target, or
+	  * removes the limit again
+	  */
+	void setScissor(TextureFBO& target, unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+	void clearScissor();
+
+	static void renderMeshRecursive(const MeshPart& mesh, GLint modelview_location, GLint modelview_inverse_location,
+			const glm::mat4& modelview, const glm::mat4& transform);
+
+	static const unsigned int max_vaos = 4;
+	GLuint vaos[max_vaos]; //< Vertex array objects: model, quad, one without attributes, and the model for the G-buffer
 	std::shared_ptr<GLUtils::BO<GL_ARRAY_BUFFER> > vertices;
 	std::shared_ptr<GLUtils::BO<GL_ELEMENT_ARRAY_BUFFER> > indices;
 	std::shared_ptr<GLUtils::Program> phong_program, passthrough_program, horizontal_blur_program, vertical_blur_program, greyscale_program;
+	std::shared_ptr<GLUtils::Program> recursive_blur_program, box_blur_program; //< NULL without compute shader support
+	std::shared_ptr<GLUtils::Program> separable_blur_program; //< NULL without compute shader support
+	std::shared_ptr<GLUtils::Program> sat_scan_program; //< NULL without compute shader support
+	std::shared_ptr<GLUtils::Program> sat_blur_program;
+	std::shared_ptr<GLUtils::Program> bilateral_splat_program, bilateral_blur_program, bilateral_slice_program;
+	std::shared_ptr<GLUtils::Program> luminance_histogram_program, luminance_average_program; //< NULL without compute shader support
+	std::shared_ptr<GLUtils::Program> tonemap_program;
+	std::shared_ptr<GLUtils::Program> temporal_blur_program, temporal_upsample_program;
+	std::shared_ptr<GLUtils::Program> gbuffer_program, deferred_lighting_program;
+	std::shared_ptr<GLUtils::Program> dof_prepare_program, dof_gather_program, dof_composite_program;
+	std::shared_ptr<GLUtils::Program> bloom_bright_program, bloom_downsample_program, bloom_upsample_program, bloom_composite_program;
+	std::shared_ptr<GLUtils::Program> fxaa_program;
+	std::shared_ptr<GLUtils::BO<GL_SHADER_STORAGE_BUFFER> > histogram_buffer;
 
 	std::shared_ptr<Model> model;
-	//Fbos for rendering
+	//Fbos for rendering, taken from the pool
+	TargetPool target_pool;
 	std::shared_ptr<TextureFBO> fbo1;
+	std::shared_ptr<TextureFBO> msaa_fbo; //< Multisampled scene, resolved into fbo1, while using MSAA
+	std::shared_ptr<TextureFBO> fxaa_fbo; //< Antialiased scene, while using FXAA
 	std::shared_ptr<TextureFBO> fbo2;
+	std::shared_ptr<TextureFBO> greyscale_fbo;
+	std::shared_ptr<TextureFBO> blur_fbo;
+	std::shared_ptr<TextureFBO3D> grid_fbos[2]; //< Bilateral grid, and its blur ping-pong target
+	glm::vec3 grid_size; //< Cells of the bilateral grid, in x, y and luminance
+	std::shared_ptr<TextureFBO> exposure_fbo; //< 1x1, the adapted average luminance in red
+	std::shared_ptr<TextureFBO> history_fbos[2]; //< Downscaled temporal blur, the last result and the next
+	std::shared_ptr<TextureFBO> gbuffer; //< Normals and materials of the scene, for deferred shading
+	std::shared_ptr<SummedAreaTable> summed_area_table; //< Of the input of the variable blur
+	std::shared_ptr<TextureFBO> dof_fbos[2]; //< Downscaled scene with its circle of confusion, and the gathered blur
+	static const unsigned int bloom_levels = 5;
+	std::shared_ptr<TextureFBO> bloom_fbos[bloom_levels]; //< Bloom pyramid, from half the scene resolution down
+
+	std::shared_ptr<FrameCapture> capture; //< Records the output while active
+	std::shared_ptr<TextureFBO> capture_fbo; //< Output upscaled to the capture size, below full render scale
+	std::shared_ptr<PassProfiler> profiler; //< Times each pass while set
+	std::shared_ptr<ResolutionController> resolution_controller; //< Adjusts render_scale while set
+	std::shared_ptr<InputTrace> recording; //< Input applied so far, while recording
+	std::shared_ptr<InputTrace> replay; //< Input to apply instead of live input, while replaying
+	std::string recording_filename;
+	uint32_t frame_index; //< Frames rendered since play()
+	bool print_statistics; //< Print the passes of the next profiled frame
+
+	//Fingerprints of the inputs each pass last ran with
+	CachedStage scene_stage;
+	CachedStage fxaa_stage;
+	CachedStage greyscale_stage;
+	CachedStage vertical_blur_stage;
+	CachedStage horizontal_blur_stage;
+	CachedStage wide_blur_stage; //< Recursive or box blur, also writes blur_fbo
+	CachedStage bilateral_stage; //< Also writes blur_fbo
+	CachedStage temporal_blur_stage; //< Also writes blur_fbo
+	CachedStage split_stage; //< Also writes blur_fbo
+	CachedStage dof_stage; //< Also writes blur_fbo
+	CachedStage bloom_stage; //< The pyramid in bloom_fbos
+	CachedStage variable_blur_stage; //< Also writes blur_fbo
+	float pass_coverage; //< Fraction of the target the scissor leaves, to scale the traffic estimates
 
 	Timer my_timer; //< Timer for machine independent motion
+	Timer exposure_timer; //< Time since the exposure last adapted
+	uint64_t metered_fingerprint; //< Scene the exposure is adapting to
+	uint64_t exposure_settle_deadline; //< Keep rendering until the exposure has adapted
+	unsigned int history_index; //< history_fbos element holding the last result
+	bool history_valid; //< history_fbos holds a result rendered with history_view_matrix
+	glm::mat4 history_view_matrix;
+	bool deferred_shading; //< Render the scene with deferred shading and light_count lights
+	unsigned int light_count;
+	static const unsigned int max_lights = 1024;
+	std::vector<glm::vec4> light_spheres; //< World space position and radius of each light
+	std::vector<glm::vec4> light_colors;
+	std::vector<glm::vec4> view_lights; //< light_spheres in view space, reused every frame
+	std::vector<glm::vec4> light_data; //< View space sphere and colour of each light, as uploaded
+	LightClusters light_clusters;
+	std::shared_ptr<GLUtils::BO<GL_TEXTURE_BUFFER> > light_buffer, cluster_buffer, light_index_buffer;
+	GLuint light_textures[3]; //< Buffer textures of the three buffers above
+	unsigned int temporal_frame; //< Counts temporal blur passes, to pick the tiles to refresh
+	unsigned int temporal_refresh_frames; //< Temporal blur passes since the scene last changed
+	FrameScheduler scheduler; //< Decides when to render and how long to sleep
 
 	glm::mat4 projection_matrix; //< OpenGL projection matrix
 	glm::mat4 model_matrix; //< OpenGL model transformation matrix
@@ -119,11 +487,30 @@ private:
 	
 	VirtualTrackball trackball;
 
+	//Input is passed from the SDL thread to the render thread
+	InputQueue input_queue;
+	std::thread render_thread;
+	std::mutex wake_mutex; //< Only used to sleep, never held while handling input
+	std::condition_variable wake_render;
+	std::atomic<bool> running;
+	std::exception_ptr render_error;
+	unsigned int motion_events; //< Motion events received by the render thread
+	unsigned int trackball_updates; //< Trackball rotations actually computed
+
 	static GLubyte quad_indices[];
 	static GLfloat quad_vertices[];
-	static unsigned int downscale_level;
+	unsigned int downscale_level;
+	unsigned int dof_downscale_level; //< Of the depth of field targets, which need more detail than the blur
+	float render_scale; //< Scene target size relative to the window
+	float range_sigma; //< Luminance covered by one bilateral grid layer
+	RecursiveBlur::Coefficients recursive_coefficients; //< Cached for recursive_sigma
+	float recursive_sigma;
+	bool track_allocations; //< Count heap allocations made by render()
+	unsigned int tracked_frames;
+	static const unsigned int grid_padding = 2; //< Empty grid cells on each side, the blur kernel radius
 
 	RenderMode filterMode;
+	Antialiasing antialiasing;
 	
 };
 
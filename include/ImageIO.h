@@ -0,0 +1,68 @@
+#ifndef _IMAGEIO_H_
+#define _IMAGEIO_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+/**
+ * Minimal image readers and writers without external dependencies.
+ * All functions take tightly packed 8 bit RGBA pixels, and
+ * flip_y flips the rows, as OpenGL returns images bottom-up.
+ */
+class ImageIO {
+public:
+	/**
+	 * Reads a binary PGM (P5) or PPM (P6) with 8 bit samples into
+	 * rgba, top row first, with opaque alpha
+	 */
+	static void readPNM(const std::string& filename, unsigned int& width, unsigned int& height,
+			std::vector<unsigned char>& rgba);
+
+	/**
+	 * Parses the header of a PGM or PPM in memory, and returns the
+	 * offset of the samples, which are channels bytes per pixel
+	 */
+	static size_t readPNMHeader(const unsigned char* data, size_t bytes, unsigned int& width, unsigned int& height,
+			unsigned int& channels, unsigned int& max_value);
+
+	/**
+	 * Converts the samples of a PGM or PPM to opaque RGBA
+	 */
+	static void expandPNM(const unsigned char* samples, unsigned int channels, unsigned int max_value,
+			unsigned char* rgba, size_t pixels);
+
+	/**
+	 * Writes an RGBA PNG. The image data is stored uncompressed
+	 * (deflate "stored" blocks), which is fast to produce and
+	 * readable by any PNG decoder. Without alpha, an RGB PNG is
+	 * written and the alpha of rgba is ignored, for images whose
+	 * alpha is not opacity.
+	 */
+	static void writePNG(const std::string& filename, unsigned int width, unsigned int height,
+			const unsigned char* rgba, bool flip_y=true, bool alpha=true);
+
+private:
+	static const unsigned char* readHeaderValue(const unsigned char* p, const unsigned char* end, unsigned int& value);
+	static void writeChunk(std::ofstream& file, const char type[4], const unsigned char* data, size_t bytes);
+	static unsigned int crc32(unsigned int crc, const unsigned char* data, size_t bytes);
+};
+
+/**
+ * Streams frames to a YUV4MPEG2 (.y4m) file with 4:4:4 chroma,
+ * which most video tools (ffmpeg, mpv, x264) read directly
+ */
+class Y4MWriter {
+public:
+	Y4MWriter(const std::string& filename, unsigned int width, unsigned int height, unsigned int fps);
+	~Y4MWriter();
+
+	void writeFrame(const unsigned char* rgba, bool flip_y=true);
+
+private:
+	std::ofstream file;
+	unsigned int width, height;
+	std::vector<unsigned char> planes; //< Y, Cb and Cr planes of one frame
+};
+
+#endif // _IMAGEIO_H_
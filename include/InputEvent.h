@@ -0,0 +1,33 @@
+#ifndef _INPUTEVENT_H_
+#define _INPUTEVENT_H_
+
+#include <cstdint>
+
+#include "SPSCQueue.h"
+
+enum InputEventType {
+	INPUT_ROTATE_BEGIN, //< Mouse button pressed
+	INPUT_ROTATE_END, //< Mouse button released
+	INPUT_MOTION, //< Mouse moved
+	INPUT_KEY, //< Key pressed
+	INPUT_REDRAW, //< Window exposed, restored etc.
+	INPUT_RESIZE, //< Window resized to x by y
+	INPUT_QUIT,
+	INPUT_RESIZE_SETTLED, //< The window size settled, reallocate the targets
+	INPUT_RENDER_SCALE //< Dynamic resolution picked the scale (float bits in x) and downscale level (y)
+};
+
+/**
+ * The part of an SDL event the renderer cares about, small
+ * enough to copy through a lock-free queue
+ */
+struct InputEvent {
+	uint8_t type; //< InputEventType
+	uint16_t mod; //< Key modifiers for INPUT_KEY
+	int32_t x, y; //< Mouse position, or key code in x for INPUT_KEY
+	uint64_t timestamp; //< Timer::getCurrentTimeNs() when the event was received
+};
+
+typedef SPSCQueue<InputEvent, 1024> InputQueue;
+
+#endif // _INPUTEVENT_H_
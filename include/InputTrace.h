@@ -0,0 +1,61 @@
+#ifndef _INPUTTRACE_H_
+#define _INPUTTRACE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "InputEvent.h"
+
+/**
+ * The input events a session applied, each with the number of the
+ * frame it was applied before, so that the session can be replayed
+ * frame by frame.
+ *
+ * The file starts with the window size, render mode and downscale
+ * level the session started with. The events follow, with the frame
+ * number and timestamp delta encoded and the rest as variable length
+ * integers, which makes most events three to six bytes.
+ */
+class InputTrace {
+public:
+	struct State {
+		uint32_t width, height;
+		uint32_t render_mode;
+		uint32_t downscale_level;
+	};
+
+	InputTrace();
+
+	/**
+	 * Appends an event applied before the given frame
+	 */
+	void add(uint32_t frame, const InputEvent& event);
+
+	/**
+	 * Returns the next event applied before the given frame, or
+	 * false if the next one belongs to a later frame
+	 */
+	bool next(uint32_t frame, InputEvent& event);
+
+	bool finished() const { return position == entries.size(); }
+	size_t size() const { return entries.size(); }
+
+	void setInitialState(const State& state) { initial_state = state; }
+	const State& getInitialState() const { return initial_state; }
+
+	void save(const std::string& filename) const;
+	void load(const std::string& filename);
+
+private:
+	struct Entry {
+		uint32_t frame;
+		InputEvent event;
+	};
+
+	std::vector<Entry> entries;
+	size_t position; //< Next entry to replay
+	State initial_state;
+};
+
+#endif // _INPUTTRACE_H_
@@ -0,0 +1,75 @@
+#ifndef _LIGHTCLUSTERS_H_
+#define _LIGHTCLUSTERS_H_
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+ * Assigns point lights to the clusters of a view frustum, for
+ * clustered deferred shading.
+ *
+ * The frustum is split into tiles_x by tiles_y screen tiles, and
+ * into slices along the view axis that grow exponentially with the
+ * distance, so clusters are roughly cubic. Each light is a sphere
+ * in view space, and is listed in every cluster whose bounding box
+ * it touches. The lighting pass then only evaluates the lights of
+ * the fragment's cluster, so its cost grows with the lights per
+ * cluster, not with the total number of lights.
+ */
+class LightClusters {
+public:
+	static const unsigned int tiles_x = 16;
+	static const unsigned int tiles_y = 9;
+	static const unsigned int slices = 24;
+	static const unsigned int cluster_count = tiles_x*tiles_y*slices;
+
+	LightClusters();
+
+	/**
+	 * Computes the bounding boxes of the clusters. z_near and z_far are
+	 * the positive distances of the clip planes of projection.
+	 */
+	void setProjection(const glm::mat4& projection, float z_near, float z_far);
+
+	/**
+	 * Builds the light lists. Each light is its view space position
+	 * in xyz, and its radius in w.
+	 */
+	void assign(const glm::vec4* lights, unsigned int count);
+
+	/**
+	 * Offset into getIndices() and number of lights of each cluster,
+	 * interleaved. Cluster x + tiles_x*(y + tiles_y*slice) has y = 0
+	 * at the bottom of the screen and slice 0 at the near plane.
+	 */
+	const std::vector<unsigned int>& getClusters() const { return clusters; }
+	const std::vector<unsigned int>& getIndices() const { return indices; }
+
+	unsigned int getMaxLightsPerCluster() const { return max_lights; }
+	float getNear() const { return z_near; }
+	float getFar() const { return z_far; }
+
+private:
+	/**
+	 * Appends the lights among the current slice's candidates
+	 * that touch cluster c, and returns how many there were
+	 */
+	unsigned int cullCluster(unsigned int c);
+
+	float z_near, z_far; //< Distances of the clip planes
+
+	//Bounding boxes of the clusters, one array per bound
+	std::vector<float> min_x, min_y, min_z, max_x, max_y, max_z;
+
+	//Lights that overlap the slice being assigned, padded to a
+	//multiple of four with lights that touch nothing
+	std::vector<float> light_x, light_y, light_z, light_r2;
+	std::vector<unsigned int> light_index;
+
+	std::vector<unsigned int> clusters;
+	std::vector<unsigned int> indices;
+	unsigned int max_lights;
+};
+
+#endif // _LIGHTCLUSTERS_H_
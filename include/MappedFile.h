@@ -0,0 +1,52 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <string>
+#include <cstddef>
+
+/**
+ * Maps a whole file into the address space. The operating system
+ * pages it in on access and can drop clean or written back pages
+ * again, so files larger than memory can be processed piece by piece.
+ */
+class MappedFile {
+public:
+	/**
+	 * Maps an existing file for reading
+	 */
+	explicit MappedFile(const std::string& filename);
+
+	/**
+	 * Creates (or truncates) a file of the given size, and maps it
+	 * for writing
+	 */
+	MappedFile(const std::string& filename, size_t size);
+
+	~MappedFile();
+
+	unsigned char* getData() { return data; }
+	size_t getSize() { return size; }
+
+	/**
+	 * Tells the operating system that the given range will not be
+	 * accessed again soon, so its pages can be reclaimed first
+	 */
+	void release(size_t offset, size_t bytes);
+
+private:
+	MappedFile(const MappedFile&); //< Not copyable, the copy would unmap twice
+	MappedFile& operator=(const MappedFile&);
+
+	void map(const std::string& filename, bool writable);
+
+	unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	void* file; //< HANDLE
+	void* mapping; //< HANDLE
+#else
+	int file;
+#endif
+};
+
+#endif // _MAPPEDFILE_H_
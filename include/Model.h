@@ -27,7 +27,7 @@ public:
 	Model(std::string filename, bool invert=0);
 	~Model();
 
-	inline MeshPart getMesh() {return root;}
+	inline const MeshPart& getMesh() const {return root;}
 	inline std::shared_ptr<GLUtils::BO<GL_ARRAY_BUFFER> > getVertices() {return vertices;}
 	inline std::shared_ptr<GLUtils::BO<GL_ARRAY_BUFFER> > getNormals() {return normals;}
 	inline std::shared_ptr<GLUtils::BO<GL_ARRAY_BUFFER> > getColors() {return colors;}
@@ -0,0 +1,67 @@
+#ifndef _PASSCACHE_H_
+#define _PASSCACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Builds a 64 bit FNV-1a hash over everything a render pass
+ * depends on: matrices, program, uniforms and upstream targets.
+ */
+class Fingerprint {
+public:
+	Fingerprint() : hash(14695981039346656037ULL) {}
+
+	inline Fingerprint& add(const void* data, size_t bytes) {
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		for (size_t i=0; i<bytes; ++i) {
+			hash ^= p[i];
+			hash *= 1099511628211ULL;
+		}
+		return *this;
+	}
+
+	template <typename T>
+	inline Fingerprint& add(const T& value) {
+		return add(&value, sizeof(T));
+	}
+
+	inline uint64_t value() const { return hash; }
+
+private:
+	uint64_t hash;
+};
+
+/**
+ * Remembers the fingerprint of the inputs a stage was last run
+ * with, so that the stage can be skipped while they are unchanged
+ */
+class CachedStage {
+public:
+	CachedStage() : fingerprint(0), valid(false) {}
+
+	/**
+	 * Returns true (and remembers the new fingerprint) if the
+	 * stage has to be re-run for the given inputs
+	 */
+	inline bool needsUpdate(uint64_t fingerprint) {
+		if (valid && this->fingerprint == fingerprint) return false;
+		this->fingerprint = fingerprint;
+		valid = true;
+		return true;
+	}
+
+	/**
+	 * Forces the stage to run next time, e.g., when its
+	 * output target has been reallocated
+	 */
+	inline void invalidate() { valid = false; }
+
+	inline uint64_t getFingerprint() const { return fingerprint; }
+
+private:
+	uint64_t fingerprint;
+	bool valid;
+};
+
+#endif // _PASSCACHE_H_
@@ -0,0 +1,123 @@
+#ifndef _PASSPROFILER_H_
+#define _PASSPROFILER_H_
+
+#include <cstdint>
+#include <ostream>
+
+#include <GL/glew.h>
+
+#include "AllocationTracker.h"
+#include "Tracer.h"
+
+/**
+ * What one pass did on the GPU. The invocation counts need
+ * GL_ARB_pipeline_statistics_query, and are zero without it.
+ * The memory traffic is estimated from the sizes and formats of
+ * the targets, as given to addTraffic.
+ */
+struct PassStatistics {
+	uint64_t vertices; //< Vertex shader invocations
+	uint64_t fragments; //< Fragment shader invocations
+	uint64_t compute; //< Compute shader invocations
+	uint64_t samples; //< Samples that passed the depth test
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+};
+
+/**
+ * GPU times of the passes of one frame, in milliseconds, and
+ * what each pass did
+ */
+struct PassTimings {
+	static const unsigned int max_passes = 16;
+
+	PassTimings() : n_passes(0), total(0) {}
+	unsigned int n_passes;
+	const char* names[max_passes]; //< Pass names, as given to beginPass
+	double times[max_passes];
+	PassStatistics statistics[max_passes];
+	double total; //< From beginFrame to endFrame
+
+	/**
+	 * Writes a table of the passes, with their time, invocations and traffic
+	 */
+	void print(std::ostream& out) const;
+};
+
+/**
+ * Measures the GPU time of each pass with timestamp queries, and
+ * counts its shader invocations and the samples it wrote with
+ * pipeline statistics and occlusion queries.
+ *
+ * Queries are kept for several frames in flight, and are only read
+ * back once the GPU has finished them, so profiling does not stall
+ * the pipeline. Pass names must be string literals (or otherwise
+ * outlive the profiler), as only the pointers are stored.
+ */
+class PassProfiler {
+public:
+	PassProfiler();
+	~PassProfiler();
+
+	void beginFrame();
+	void endFrame();
+
+	void beginPass(const char* name);
+	void endPass();
+
+	/**
+	 * Adds estimated memory traffic to the current pass
+	 */
+	void addTraffic(uint64_t bytes_read, uint64_t bytes_written);
+
+	bool hasPipelineStatistics() { return pipeline_statistics; }
+
+	/**
+	 * Reads back the oldest finished frame into timings. Returns false
+	 * if no frame is ready; if wait is true, blocks until the oldest
+	 * frame in flight is ready instead.
+	 */
+	bool collect(PassTimings& timings, bool wait=false);
+
+private:
+	static const unsigned int frames_in_flight = 4;
+	static const unsigned int queries_per_frame = 2*PassTimings::max_passes + 2;
+	static const unsigned int counters_per_pass = 4;
+	static const GLenum counter_targets[counters_per_pass]; //< Vertex, fragment and compute invocations, samples passed
+
+	struct FrameQueries {
+		GLuint queries[queries_per_frame]; //< Frame begin, frame end, then begin/end for each pass
+		GLuint counters[PassTimings::max_passes][counters_per_pass];
+		const char* names[PassTimings::max_passes];
+		uint64_t bytes_read[PassTimings::max_passes];
+		uint64_t bytes_written[PassTimings::max_passes];
+		unsigned int n_passes;
+	};
+
+	FrameQueries frames[frames_in_flight];
+	unsigned int head; //< Frame being recorded
+	unsigned int pending; //< Frames recorded but not collected
+	bool in_pass;
+	bool pipeline_statistics; //< GL_ARB_pipeline_statistics_query is supported
+	bool counter_enabled[counters_per_pass]; //< Which counters the GL supports
+};
+
+/**
+ * Times the enclosing scope as one pass. Does nothing if
+ * the profiler is NULL, except for tracing the scope.
+ */
+class ProfileScope {
+public:
+	ProfileScope(PassProfiler* profiler, const char* name) : profiler(profiler), allocation_scope(name), trace_scope(name) {
+		if (profiler) profiler->beginPass(name);
+	}
+	~ProfileScope() {
+		if (profiler) profiler->endPass();
+	}
+private:
+	PassProfiler* profiler;
+	AllocationScope allocation_scope; //< Heap allocations are attributed to the pass too
+	TraceScope trace_scope; //< As is the CPU time, when tracing
+};
+
+#endif // _PASSPROFILER_H_
@@ -0,0 +1,85 @@
+#ifndef _RECURSIVEBLUR_H_
+#define _RECURSIVEBLUR_H_
+
+#include <vector>
+
+#include "BlurKernel.h"
+
+/**
+ * Blurs whose cost per pixel does not depend on the blur width,
+ * for very wide blurs. Images are tightly packed RGBA floats.
+ *
+ * gaussian() is the Young - van Vliet recursive (IIR) Gaussian:
+ * a third order causal filter followed by an anti-causal one, in
+ * each direction. boxCascade() approximates a Gaussian by repeated
+ * box filters, each computed with a running sum.
+ *
+ * With SSE, each pixel's four channels are processed as one vector.
+ * The vertical passes sweep down the image a whole row at a time, so
+ * the recursion runs across rows while memory is read contiguously.
+ */
+class RecursiveBlur {
+public:
+	/**
+	 * Recursion coefficients, normalised by b0:
+	 * w[n] = B*x[n] + b1*w[n-1] + b2*w[n-2] + b3*w[n-3]
+	 *
+	 * M gives the anti-causal state just past the end of a line, so
+	 * the result is exact for clamp-to-edge (Triggs and Sdika):
+	 * y[N+i] - x[N-1] = sum_j M[i][j]*(w[N-1-j] - x[N-1])
+	 */
+	struct Coefficients {
+		float B, b1, b2, b3;
+		float M[3][3];
+	};
+
+	/**
+	 * Coefficients of the recursive Gaussian for sigma >= 0.5
+	 */
+	static Coefficients computeCoefficients(float sigma);
+
+	/**
+	 * Computes n box widths (odd) whose cascade approximates
+	 * a Gaussian of the given sigma
+	 */
+	static void computeBoxSizes(float sigma, unsigned int n, unsigned int* sizes);
+
+	static void gaussian(float* rgba, unsigned int width, unsigned int height, float sigma);
+	static void boxCascade(float* rgba, unsigned int width, unsigned int height, float sigma, unsigned int passes=3);
+
+	/**
+	 * Reference separable FIR convolution with clamp-to-edge, using
+	 * the symmetric kernel weights[0..radius]
+	 */
+	static void convolve(float* rgba, unsigned int width, unsigned int height,
+			const float* weights, unsigned int radius);
+
+	/**
+	 * Error of one filter at one sigma against its reference,
+	 * relative to the value range of the test image
+	 */
+	struct ValidationResult {
+		const char* filter; //< "recursive" or "box"
+		float sigma;
+		double max_error;
+		double rms_error;
+	};
+
+	/**
+	 * Compares the recursive Gaussian and box cascade against the
+	 * separable 11-tap kernel used by the blur shaders (sigma 1), and
+	 * against an exact FIR Gaussian for a wide sigma. Prints the
+	 * maximum and RMS errors as JSON, and returns them per case.
+	 */
+	static std::vector<ValidationResult> validate(unsigned int width=256, unsigned int height=256);
+
+	static const float kernel_weights[BlurKernel::radius+1]; //< Weights of horizontal_blur.frag/vertical_blur.frag
+
+private:
+	static void gaussianRows(float* rgba, unsigned int width, unsigned int height, const Coefficients& c);
+	static void gaussianColumns(float* rgba, unsigned int width, unsigned int height, const Coefficients& c);
+	static void boxRows(const float* in, float* out, unsigned int width, unsigned int height, unsigned int radius);
+	static void boxColumns(const float* in, float* out, unsigned int width, unsigned int height, unsigned int radius);
+};
+
+#endif // _RECURSIVEBLUR_H_
@@ -0,0 +1,63 @@
+#ifndef _RESOLUTIONCONTROLLER_H_
+#define _RESOLUTIONCONTROLLER_H_
+
+/**
+ * Chooses the scene resolution scale and blur downscale level
+ * that keep the measured GPU frame time within a budget.
+ *
+ * The controller walks a ladder of quality steps: it steps down
+ * quickly when the smoothed frame time goes over budget, and only
+ * steps back up after the frame time has stayed well below budget
+ * for a while, so it does not oscillate between two steps.
+ */
+class ResolutionController {
+public:
+	ResolutionController(double budget_ms=16.6, unsigned int base_downscale_level=4);
+
+	/**
+	 * Feeds the GPU time of one frame. Returns true if the
+	 * quality step changed, and the targets must be resized.
+	 */
+	bool update(double gpu_frame_ms);
+
+	/**
+	 * Scale of the scene target relative to the window
+	 */
+	float getScale() const;
+
+	/**
+	 * Downscale level of the blur target relative to the scene target
+	 */
+	unsigned int getDownscaleLevel() const;
+
+	unsigned int getStep() const { return step; }
+	double getBudget() const { return budget; }
+	double getSmoothedFrameTime() const { return smoothed; }
+
+	void setBudget(double budget_ms) { budget = budget_ms; }
+
+	/**
+	 * Goes back to full quality
+	 */
+	void reset();
+
+private:
+	struct Step {
+		float scale;
+		unsigned int extra_downscale; //< Added to the base downscale level
+	};
+	static const Step steps[];
+	static const unsigned int n_steps;
+
+	static const unsigned int settle_frames = 8; //< Ignore measurements right after a change
+	static const unsigned int upgrade_frames = 60; //< Frames under budget before stepping up
+
+	double budget;
+	unsigned int base_downscale_level;
+	unsigned int step; //< 0 is full quality
+	double smoothed; //< Exponential moving average of the frame time
+	unsigned int frames_since_change;
+	unsigned int frames_under_budget;
+};
+
+#endif // _RESOLUTIONCONTROLLER_H_
@@ -0,0 +1,78 @@
+#ifndef _RESOURCEREGISTRY_H_
+#define _RESOURCEREGISTRY_H_
+
+#include <cstddef>
+#include <ostream>
+
+#include <GL/glew.h>
+
+enum ResourceType {
+	RESOURCE_BUFFER,
+	RESOURCE_TEXTURE,
+	RESOURCE_RENDERBUFFER,
+	RESOURCE_FRAMEBUFFER,
+	RESOURCE_PROGRAM,
+	RESOURCE_SHADER,
+	RESOURCE_VERTEX_ARRAY,
+	RESOURCE_TYPE_COUNT
+};
+
+/**
+ * Keeps track of every live OpenGL object created through the GL
+ * wrappers, with an estimate of the memory it holds, so that the
+ * memory in use can be reported and leaks found at shutdown.
+ *
+ * Objects are attributed to the innermost ResourceScope of the
+ * creating thread. Scope names must be string literals (or otherwise
+ * outlive the registry).
+ */
+class ResourceRegistry {
+public:
+	/**
+	 * Records the creation of an object of the given type and name,
+	 * holding about bytes of memory
+	 */
+	static void add(ResourceType type, GLuint name, size_t bytes);
+
+	/**
+	 * Records the deletion of an object
+	 */
+	static void remove(ResourceType type, GLuint name);
+
+	/**
+	 * Records that an object now holds about bytes of memory. Unlike
+	 * removing and adding it again, this does not allocate.
+	 */
+	static void resize(ResourceType type, GLuint name, size_t bytes);
+
+	static size_t getBytes(); //< Memory held by the live objects
+	static size_t getPeakBytes(); //< Most memory held at any time
+
+	/**
+	 * Writes the live objects and memory per type, and the peaks
+	 */
+	static void dump(std::ostream& out);
+
+	/**
+	 * Writes every object that is still alive, grouped by type and
+	 * creation site. Meant for shutdown, after everything should have
+	 * been released. Returns true if nothing is left.
+	 */
+	static bool reportLeaks(std::ostream& out);
+
+	static const char* getTypeName(ResourceType type);
+};
+
+/**
+ * Attributes the GL objects created by the calling thread to
+ * name while in scope
+ */
+class ResourceScope {
+public:
+	ResourceScope(const char* name);
+	~ResourceScope();
+private:
+	const char* previous;
+};
+
+#endif // _RESOURCEREGISTRY_H_
@@ -0,0 +1,60 @@
+#ifndef _SPSCQUEUE_H_
+#define _SPSCQUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Bounded lock-free queue for exactly one producer thread and one
+ * consumer thread. Capacity must be a power of two.
+ *
+ * The producer only writes tail and the consumer only writes head,
+ * so each side needs a single acquire load of the other's index.
+ */
+template <typename T, size_t Capacity>
+class SPSCQueue {
+public:
+	SPSCQueue() : head(0), tail(0) {
+		static_assert((Capacity & (Capacity-1)) == 0, "Capacity must be a power of two");
+	}
+
+	/**
+	 * Producer side. Returns false if the queue is full.
+	 */
+	bool push(const T& item) {
+		const size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+		items[t & (Capacity-1)] = item;
+		tail.store(t+1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Consumer side. Returns false if the queue is empty.
+	 */
+	bool pop(T& item) {
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		item = items[h & (Capacity-1)];
+		head.store(h+1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Either side; the result may be stale by the time it is used
+	 */
+	bool empty() const {
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+private:
+	T items[Capacity];
+	//Keep the indices on separate cache lines, so the two threads do not false share
+	char pad0[64];
+	std::atomic<size_t> head; //< Next item to pop
+	char pad1[64];
+	std::atomic<size_t> tail; //< Next free slot
+	char pad2[64];
+};
+
+#endif // _SPSCQUEUE_H_
@@ -0,0 +1,39 @@
+#ifndef _SUMMEDAREATABLE_H_
+#define _SUMMEDAREATABLE_H_
+
+#include "GLUtils/GLUtils.hpp"
+
+/**
+ * Texture for the summed-area table of an image: every texel holds
+ * the sum of the image over the rectangle from the origin up to and
+ * including it, so the sum over a box of any size takes four fetches.
+ *
+ * The sums are fixed point with fraction_bits bits of fraction in
+ * RGBA32UI, and wrap around on overflow. The arithmetic is exact modulo
+ * 2^32, so a box sum is exact whenever it fits in 32 bits, however large
+ * the totals grow. Float sums would instead lose the small values once
+ * the totals are large. With values clamped to max_value, a box of up
+ * to max_box_pixels pixels fits.
+ */
+class SummedAreaTable {
+public:
+	static const unsigned int fraction_bits = 12;
+	static const unsigned int max_value = 16;
+	static const unsigned int max_box_pixels = (1u << (32 - fraction_bits)) / max_value;
+
+	SummedAreaTable(unsigned int width, unsigned int height);
+	~SummedAreaTable();
+
+	unsigned int getWidth() { return width; }
+	unsigned int getHeight() { return height; }
+
+	GLuint getTexture() { return texture; }
+
+	size_t getBytes() { return width*height*4*sizeof(GLuint); } //< RGBA32UI
+
+private:
+	GLuint texture;
+	unsigned int width, height;
+};
+
+#endif // _SUMMEDAREATABLE_H_
@@ -0,0 +1,64 @@
+#ifndef _TARGETPOOL_H_
+#define _TARGETPOOL_H_
+
+#include <memory>
+#include <vector>
+
+#include "TextureFBO.h"
+
+/**
+ * Keeps render targets alive after they are released, so that
+ * switching back and forth between sizes reuses them instead of
+ * reallocating GPU memory.
+ *
+ * A target is in use while anyone but the pool holds a reference
+ * to it; dropping the shared_ptr returns it to the pool.
+ */
+class TargetPool {
+public:
+	TargetPool(unsigned int max_free=8);
+	~TargetPool();
+
+	/**
+	 * Returns an unused target of the given size and number of
+	 * samples, creating one if the pool has none
+	 */
+	std::shared_ptr<TextureFBO> acquire(unsigned int width, unsigned int height, unsigned int samples=0);
+
+	/**
+	 * Drops every target that is not in use
+	 */
+	void clear();
+
+	/**
+	 * Sets how many unused targets are kept, e.g., enough for the
+	 * targets of the sizes the owner switches between
+	 */
+	void setMaxFree(unsigned int max_free) { this->max_free = max_free; }
+
+	/**
+	 * Number of targets held by someone besides the pool
+	 */
+	unsigned int getInUse();
+
+	unsigned int getAllocations() { return allocations; }
+
+private:
+	/**
+	 * Frees the least recently used unused targets until at
+	 * most max_free remain
+	 */
+	void trim();
+
+	struct Entry {
+		std::shared_ptr<TextureFBO> target;
+		unsigned long long last_used;
+	};
+
+	std::vector<Entry> entries;
+	unsigned int max_free;
+	unsigned long long clock; //< Counts acquires, for LRU eviction
+	unsigned int allocations; //< Number of targets created
+};
+
+#endif // _TARGETPOOL_H_
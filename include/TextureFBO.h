@@ -3,23 +3,47 @@
 
 #include "GLUtils/GLUtils.hpp"
 
+/**
+ * Framebuffer with RGBA32F colour textures and a depth texture. With
+ * several colour attachments, fragment output i is written to
+ * attachment i, e.g., for a G-buffer.
+ *
+ * With samples > 0 the textures are multisampled. They cannot be
+ * filtered, so resolve() them into a single sampled target first.
+ */
 class TextureFBO {
 public:
-	TextureFBO(unsigned int width, unsigned int height);
+	static const unsigned int max_color_attachments = 4;
+
+	TextureFBO(unsigned int width, unsigned int height, unsigned int color_attachments=1, unsigned int samples=0);
 	~TextureFBO();
 
 	void bind();
 	static void unbind();
 
+	/**
+	 * Copies colour and depth into target, which must have the same
+	 * size, averaging the samples of each pixel
+	 */
+	void resolve(TextureFBO& target);
+
 	unsigned int getWidth() {return width; }
 	unsigned int getHeight() {return height; }
 
-	GLuint getTexture() { return texture; }
+	GLuint getTexture(unsigned int attachment=0) { return textures[attachment]; }
+	GLuint getDepthTexture() { return depth; }
+	unsigned int getColorAttachments() { return color_attachments; }
+	unsigned int getSamples() { return samples; }
+
+	size_t getColorBytes() { return color_attachments*width*height*4*sizeof(float)*(samples > 0 ? samples : 1); } //< RGBA32F
+	size_t getDepthBytes() { return width*height*4*(samples > 0 ? samples : 1); }
 
 private:
 	GLuint fbo;
-	GLuint depth;
-	GLuint texture;
+	GLuint depth; //< Depth texture
+	GLuint textures[max_color_attachments];
+	unsigned int color_attachments;
+	unsigned int samples; //< Per pixel, or 0 for plain textures
 	unsigned int width, height;
 };
 
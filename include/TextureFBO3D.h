@@ -0,0 +1,33 @@
+#ifndef _TEXTUREFBO3D_HPP__
+#define _TEXTUREFBO3D_HPP__
+
+#include "GLUtils/GLUtils.hpp"
+
+/**
+ * Layered framebuffer with a 3D RGBA32F texture as its colour
+ * attachment. A geometry shader picks the layer each primitive
+ * is drawn to with gl_Layer.
+ */
+class TextureFBO3D {
+public:
+	TextureFBO3D(unsigned int width, unsigned int height, unsigned int depth);
+	~TextureFBO3D();
+
+	void bind();
+	static void unbind();
+
+	unsigned int getWidth() {return width; }
+	unsigned int getHeight() {return height; }
+	unsigned int getDepth() {return depth; }
+
+	GLuint getTexture() { return texture; }
+
+	size_t getBytes() { return width*height*depth*4*sizeof(float); } //< RGBA32F
+
+private:
+	GLuint fbo;
+	GLuint texture;
+	unsigned int width, height, depth;
+};
+
+#endif
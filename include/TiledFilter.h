@@ -0,0 +1,104 @@
+#ifndef _TILEDFILTER_H_
+#define _TILEDFILTER_H_
+
+#include <string>
+#include <memory>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include "TextureFBO.h"
+#include "MappedFile.h"
+
+/**
+ * Streams an image that is larger than a texture, or than memory,
+ * through the GPU filters one tile at a time.
+ *
+ * The input PGM/PPM and the output PPM are memory mapped. Every tile
+ * is read with a halo of the filter radius around it, so the filter
+ * sees the same neighbourhood as it would on the whole image, and only
+ * the tile's core is written back; the cores tile the output without
+ * seams. Outside the image the edge pixels are repeated, like
+ * GL_CLAMP_TO_EDGE. Tiles are processed row by row, and the pages of
+ * finished rows are released, so memory use is bounded by a few tiles.
+ */
+class TiledFilter {
+public:
+	/**
+	 * Tiles are tile_size square including the halo of halo pixels
+	 * on every side
+	 */
+	TiledFilter(const std::string& input, const std::string& output, unsigned int tile_size, unsigned int halo);
+
+	/**
+	 * Calls finish()
+	 */
+	~TiledFilter();
+
+	/**
+	 * Moves on to the next tile, or returns false after the last one
+	 */
+	bool next();
+
+	/**
+	 * Uploads the current tile with its halo into target, which
+	 * must be tile_size square
+	 */
+	void upload(TextureFBO& target);
+
+	/**
+	 * Starts an asynchronous read of the core of the current tile
+	 * from source, and writes finished tiles to the output
+	 */
+	void readback(TextureFBO& source);
+
+	/**
+	 * Waits for every tile, and prints the throughput
+	 */
+	void finish();
+
+	unsigned int getTileSize() { return tile_size; }
+	unsigned int getTileCount() { return tiles_x*tiles_y; }
+
+private:
+	static const unsigned int ring_size = 2; //< Tiles in flight on the GPU, per direction
+
+	/**
+	 * Maps the oldest pack buffer and writes its tile to the output.
+	 * If block is false, returns false instead of waiting when the
+	 * GPU has not finished the read yet.
+	 */
+	bool retire(bool block);
+
+	/**
+	 * Releases the pages of the rows that no tile needs any more
+	 */
+	void releaseRows(unsigned int output_rows, unsigned int input_rows);
+
+	std::unique_ptr<MappedFile> input, output;
+	size_t input_offset, output_offset; //< Start of the pixels in each file
+	unsigned int channels, max_value; //< Of the input
+	unsigned int width, height;
+
+	unsigned int tile_size, halo, core; //< core is the part of a tile that is written
+	unsigned int tiles_x, tiles_y;
+	int tile; //< Current tile, row by row
+	unsigned int input_released, output_released; //< Rows whose pages were released
+
+	GLuint upload_pbos[ring_size];
+	GLsync upload_fences[ring_size];
+	unsigned int upload_head;
+
+	struct Pending {
+		unsigned int x, y, width, height; //< Core of the tile in the output
+	};
+	GLuint readback_pbos[ring_size];
+	GLsync readback_fences[ring_size];
+	Pending pending[ring_size];
+	unsigned int readback_head, in_flight;
+
+	std::chrono::steady_clock::time_point start;
+	bool finished;
+};
+
+#endif // _TILEDFILTER_H_
@@ -1,75 +1,70 @@
 #ifndef _TIMER_H_
 #define _TIMER_H_
 
-#ifdef _WIN32
-#include <sys/timeb.h>
-#include <windows.h>
-#include <time.h>
-#else
-#include <sys/time.h>
-#include <unistd.h>
-#endif
+#include <chrono>
+#include <cstdint>
 
 
 /**
  *  A very basic timer class, suitable for FPS counters etc.
+ *  Backed by a monotonic clock, so it never jumps when the
+ *  wall clock is adjusted.
  */
 class Timer {
 
 public:
-	Timer() : startTime_(getCurrentTime()) {};
+	Timer() : startTime_(getCurrentTimeNs()) {};
 
 	/**
 	 * Report the elapsed time in seconds (it will return a double,
 	 * so the fractional part is subsecond part).
 	 */
 	inline double elapsed() const {
-		return getCurrentTime() - startTime_;
+		return (getCurrentTimeNs() - startTime_)*1e-9;
 	};
 
-	/** 
+	/**
+	 * Report the elapsed time in nanoseconds.
+	 */
+	inline uint64_t elapsedNs() const {
+		return getCurrentTimeNs() - startTime_;
+	};
+
+	/**
 	 * Report the elapsed time in seconds, and reset the timer.
 	 */
 	inline double elapsedAndRestart() {
-		double now = getCurrentTime();
-		double elapsed = now - startTime_;
+		uint64_t now = getCurrentTimeNs();
+		uint64_t elapsed = now - startTime_;
 		startTime_ = now;
-		return elapsed;
+		return elapsed*1e-9;
 	};
 
 	/**
 	 * Restart the timer.
 	 */
 	inline void restart() {
-		startTime_ = getCurrentTime();
+		startTime_ = getCurrentTimeNs();
 	};
 
-	/** 
-	 * Return the current time as number of elapsed seconds of this day.
+	/**
+	 * Return the current time in seconds since an arbitrary, fixed epoch.
 	 */
 	double static getCurrentTime() {
-#ifdef WIN32
-#if 1
-    LARGE_INTEGER f;
-    LARGE_INTEGER t;
-    QueryPerformanceFrequency(&f);
-    QueryPerformanceCounter(&t);
-    return t.QuadPart/(double) f.QuadPart;
-#else
-    struct _timeb ts;
-		_ftime(&ts);
-		return (ts.time + 0.001 * ts.millitm);
-#endif
-#else
-    struct timeval tv;
-    struct timezone tz;
-    gettimeofday(&tv, &tz);
-    return tv.tv_sec+tv.tv_usec*1e-6;
-#endif
-  };
+		return getCurrentTimeNs()*1e-9;
+	};
+
+	/**
+	 * Return the current monotonic time in nanoseconds since an
+	 * arbitrary, fixed epoch.
+	 */
+	uint64_t static getCurrentTimeNs() {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count());
+	};
 
 
 private:
-	double startTime_;
+	uint64_t startTime_;
 };
 #endif // _TIMER_H_
@@ -0,0 +1,66 @@
+#ifndef _TRACER_H_
+#define _TRACER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "Timer.h"
+
+/**
+ * Records the begin and end of named scopes on every thread, and
+ * writes them in the Chrome trace event format, which chrome://tracing
+ * and ui.perfetto.dev open directly.
+ *
+ * Each thread appends to its own fixed size buffer, so recording takes
+ * no locks; events beyond the buffer size are dropped and counted.
+ * While disabled, a scope costs one relaxed atomic load. Scope names
+ * must be string literals (or otherwise outlive the tracer).
+ */
+class Tracer {
+public:
+	static void setEnabled(bool enabled);
+	static inline bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+	/**
+	 * Names the calling thread in the trace
+	 */
+	static void setThreadName(const char* name);
+
+	/**
+	 * Records a scope on the calling thread, with times from
+	 * Timer::getCurrentTimeNs()
+	 */
+	static void record(const char* name, uint64_t begin, uint64_t end);
+
+	/**
+	 * Writes everything recorded so far to filename. Events
+	 * still being recorded by other threads may be left out.
+	 */
+	static void write(const std::string& filename);
+
+	static const unsigned int events_per_thread = 1 << 16;
+
+private:
+	static std::atomic<bool> enabled;
+};
+
+/**
+ * Records the enclosing scope while tracing is enabled
+ */
+class TraceScope {
+public:
+	TraceScope(const char* name) : name(name), begin(Tracer::isEnabled() ? Timer::getCurrentTimeNs() : 0) {}
+	~TraceScope() {
+		if (begin != 0 && Tracer::isEnabled()) Tracer::record(name, begin, Timer::getCurrentTimeNs());
+	}
+private:
+	const char* name;
+	uint64_t begin; //< Zero if tracing was disabled on entry
+};
+
+#define TRACE_CONCATENATE_(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCATENATE(trace_scope_, __LINE__)(name)
+
+#endif // _TRACER_H_
@@ -40,6 +40,11 @@ public:
 	  */
 	void setWindowSize(int w, int h);
 
+	/**
+	  * Returns true while the mouse button is held down
+	  */
+	inline bool isRotating() const { return rotating; }
+
 private:
 	/**
 	  * Returns the normalized (x=[-0.5, 0.5], y=[-0.5, 0.5]) window
@@ -0,0 +1,19 @@
+#version 150
+
+//Blurs the bilateral grid along one axis with a [1 4 6 4 1]/16 kernel
+uniform sampler3D grid;
+uniform ivec3 direction;
+flat in int layer;
+out vec4 out_color;
+
+void main() {
+	const float weights[3] = float[](0.375, 0.25, 0.0625);
+	ivec3 cell = ivec3(ivec2(gl_FragCoord.xy), layer);
+	ivec3 last = textureSize(grid, 0) - 1;
+
+	out_color = weights[0] * texelFetch(grid, cell, 0);
+	for (int i = 1; i <= 2; ++i) {
+		out_color += weights[i] * texelFetch(grid, clamp(cell - i*direction, ivec3(0), last), 0);
+		out_color += weights[i] * texelFetch(grid, clamp(cell + i*direction, ivec3(0), last), 0);
+	}
+}
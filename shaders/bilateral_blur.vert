@@ -0,0 +1,10 @@
+#version 150
+
+//Screen covering quad, drawn once per grid layer
+in vec4 position;
+flat out int vs_layer;
+
+void main() {
+	vs_layer = gl_InstanceID;
+	gl_Position = position;
+}
@@ -0,0 +1,23 @@
+#version 150
+
+//Looks up each pixel in the blurred bilateral grid, at its position and
+//luminance, and normalises the homogeneous colour found there
+uniform sampler2D my_texture;
+uniform sampler3D grid;
+uniform vec2 scene_size;
+uniform vec3 grid_size;
+uniform float sigma_s;
+uniform float sigma_r;
+uniform float padding;
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+void main() {
+	vec3 color = texture(my_texture, texCoord).rgb;
+	vec2 pixel = texCoord * scene_size - 0.5;
+	float luminance = clamp(dot(color, vec3(0.2126, 0.7152, 0.0722)), 0.0, 1.0);
+	vec3 cell = vec3(pixel / sigma_s, luminance / sigma_r) + padding;
+
+	vec4 sum = texture(grid, (cell + 0.5) / grid_size);
+	out_color = vec4((sum.a > 0.0) ? sum.rgb / sum.a : color, 1.0);
+}
@@ -0,0 +1,8 @@
+#version 150
+
+flat in vec4 color;
+out vec4 out_color;
+
+void main() {
+	out_color = color; //Summed with additive blending
+}
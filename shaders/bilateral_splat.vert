@@ -0,0 +1,24 @@
+#version 150
+
+//One point per scene pixel, placed in the bilateral grid cell given by
+//its position and luminance. The geometry shader routes it to its layer.
+uniform sampler2D my_texture;
+uniform int width; //Scene width in pixels
+uniform vec3 grid_size;
+uniform float sigma_s; //Pixels per grid cell
+uniform float sigma_r; //Luminance per grid layer
+uniform float padding; //Empty cells around the grid, for the blur
+flat out vec4 vs_color;
+flat out int vs_layer;
+
+void main() {
+	ivec2 pixel = ivec2(gl_VertexID % width, gl_VertexID / width);
+	vec3 color = texelFetch(my_texture, pixel, 0).rgb;
+	float luminance = clamp(dot(color, vec3(0.2126, 0.7152, 0.0722)), 0.0, 1.0);
+	vec3 cell = floor(vec3(vec2(pixel) / sigma_s, luminance / sigma_r) + 0.5) + padding;
+
+	//Homogeneous colour: the alpha channel counts the pixels in the cell
+	vs_color = vec4(color, 1.0);
+	vs_layer = int(cell.z);
+	gl_Position = vec4((cell.xy + 0.5) / grid_size.xy * 2.0 - 1.0, 0.0, 1.0);
+}
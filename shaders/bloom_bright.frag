@@ -0,0 +1,27 @@
+#version 150
+
+uniform sampler2D my_texture; //< Scene, with the brightness mask of phong_os.frag in alpha
+uniform sampler2D depth;
+uniform vec2 texel; //< Size of one texel of my_texture
+uniform float threshold; //< Brightness mask below which nothing glows
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+vec3 bright(vec2 uv) {
+	vec4 color = texture(my_texture, uv);
+
+	//The background is cleared to an opaque alpha, but has no surface to glow
+	float mask = clamp((color.a - threshold) / (1.0f - threshold), 0.0f, 1.0f);
+	return (texture(depth, uv).x < 1.0f) ? mask*color.rgb : vec3(0.0f);
+}
+
+void main() {
+	//Four bilinear taps average the 4x4 scene pixels around this one, so
+	//every scene pixel is read once on the way to the lower resolution
+	vec3 color = bright(texCoord + vec2(-texel.x, -texel.y));
+	color += bright(texCoord + vec2( texel.x, -texel.y));
+	color += bright(texCoord + vec2(-texel.x,  texel.y));
+	color += bright(texCoord + vec2( texel.x,  texel.y));
+
+	out_color = vec4(0.25f*color, 1.0f);
+}
@@ -0,0 +1,12 @@
+#version 150
+
+uniform sampler2D my_texture;
+uniform sampler2D bloom; //< Top of the bloom pyramid
+uniform float intensity;
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+void main() {
+	vec4 color = texture(my_texture, texCoord);
+	out_color = vec4(color.rgb + intensity*texture(bloom, texCoord).rgb, color.a);
+}
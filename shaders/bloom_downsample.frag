@@ -0,0 +1,16 @@
+#version 150
+
+uniform sampler2D my_texture;
+uniform vec2 texel; //< Size of one texel of my_texture
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+void main() {
+	//Four bilinear taps, averaging the 4x4 texels around this one
+	vec3 color = texture(my_texture, texCoord + vec2(-texel.x, -texel.y)).rgb;
+	color += texture(my_texture, texCoord + vec2( texel.x, -texel.y)).rgb;
+	color += texture(my_texture, texCoord + vec2(-texel.x,  texel.y)).rgb;
+	color += texture(my_texture, texCoord + vec2( texel.x,  texel.y)).rgb;
+
+	out_color = vec4(0.25f*color, 1.0f);
+}
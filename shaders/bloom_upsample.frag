@@ -0,0 +1,21 @@
+#version 150
+
+uniform sampler2D my_texture; //< The next smaller level of the pyramid
+uniform vec2 texel; //< Size of one texel of my_texture
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+void main() {
+	//3x3 tent filter, added onto the downsampled level with blending
+	vec3 color = 4.0f*texture(my_texture, texCoord).rgb;
+	color += 2.0f*texture(my_texture, texCoord + vec2(-texel.x, 0.0f)).rgb;
+	color += 2.0f*texture(my_texture, texCoord + vec2( texel.x, 0.0f)).rgb;
+	color += 2.0f*texture(my_texture, texCoord + vec2(0.0f, -texel.y)).rgb;
+	color += 2.0f*texture(my_texture, texCoord + vec2(0.0f,  texel.y)).rgb;
+	color += texture(my_texture, texCoord + vec2(-texel.x, -texel.y)).rgb;
+	color += texture(my_texture, texCoord + vec2( texel.x, -texel.y)).rgb;
+	color += texture(my_texture, texCoord + vec2(-texel.x,  texel.y)).rgb;
+	color += texture(my_texture, texCoord + vec2( texel.x,  texel.y)).rgb;
+
+	out_color = vec4(color / 16.0f, 1.0f);
+}
@@ -0,0 +1,64 @@
+#version 150
+uniform sampler2D normals;
+uniform sampler2D materials;
+uniform sampler2D depth;
+uniform samplerBuffer lights; //< Two texels per light: view space position and radius, then colour
+uniform usamplerBuffer clusters; //< Offset into light_indices and number of lights, per cluster
+uniform usamplerBuffer light_indices;
+
+uniform mat4 inverse_projection;
+uniform vec2 tile_size; //< Pixels per cluster tile
+uniform uvec3 cluster_counts; //< Tiles in x and y, and depth slices
+uniform float z_near;
+uniform float z_far;
+
+smooth in vec2 texCoord;
+out vec4 out_color;
+
+const vec3 key_light = vec3(200.0f, 200.0f, 200.0f); //< View space, as in phong_os.vert
+
+vec3 phong(vec3 n, vec3 v, vec3 l, vec3 diffuse, float specular) {
+	vec3 h = normalize(v+l);
+	float diff = max(0.0f, dot(n, l));
+	float spec = pow(max(0.0f, dot(n, h)), 128.0f);
+	return diff*diffuse + spec*specular;
+}
+
+void main() {
+	float d = texture(depth, texCoord).x;
+	if (d == 1.0f) discard; //Background, keep the clear colour
+
+	//Write the depth along, so later passes can use it as with forward shading
+	gl_FragDepth = d;
+
+	vec4 position = inverse_projection * vec4(vec3(texCoord, d)*2.0f - 1.0f, 1.0f);
+	vec3 p = position.xyz / position.w;
+	vec4 normal = texture(normals, texCoord);
+	vec4 material = texture(materials, texCoord);
+	vec3 n = normalize(normal.xyz);
+	vec3 v = normalize(-p);
+
+	vec3 color = phong(n, v, normalize(key_light - p), material.rgb, material.a);
+
+	//Find the cluster of the fragment, with the same exponential slices as LightClusters
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / tile_size), cluster_counts.xy - 1u);
+	float slice_f = log(-p.z / z_near) / log(z_far / z_near) * float(cluster_counts.z);
+	uint slice = uint(clamp(slice_f, 0.0f, float(cluster_counts.z - 1u)));
+	uvec2 cluster = texelFetch(clusters, int(tile.x + cluster_counts.x*(tile.y + cluster_counts.y*slice))).xy;
+
+	for (uint i=0u; i<cluster.y; ++i) {
+		int light = int(texelFetch(light_indices, int(cluster.x + i)).x);
+		vec4 light_position = texelFetch(lights, 2*light);
+		vec3 light_color = texelFetch(lights, 2*light+1).rgb;
+
+		vec3 to_light = light_position.xyz - p;
+		float dist = length(to_light);
+		if (dist >= light_position.w) continue;
+
+		//Falls smoothly to zero at the radius
+		float falloff = 1.0f - (dist*dist) / (light_position.w*light_position.w);
+		color += falloff*falloff * light_color * phong(n, v, to_light / dist, material.rgb, material.a);
+	}
+
+	out_color = vec4(color, normal.a);
+}
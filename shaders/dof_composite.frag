@@ -0,0 +1,45 @@
+#version 150
+
+uniform sampler2D my_texture; //< Scene at full resolution
+uniform sampler2D blurred; //< Result of dof_gather.frag
+uniform sampler2D depth;
+uniform float z_near;
+uniform float z_far;
+uniform float aperture;
+uniform float max_coc; //< Largest circle of confusion, in pixels of the scene
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+float linearDepth(float d) {
+	return 2.0f*z_near*z_far / (z_far + z_near - (2.0f*d - 1.0f)*(z_far - z_near));
+}
+
+void main() {
+	float focus = linearDepth(texelFetch(depth, textureSize(depth, 0)/2, 0).x);
+	float coc = clamp(aperture*(1.0f - focus/linearDepth(texture(depth, texCoord).x)), -1.0f, 1.0f);
+
+	//Bilateral upsampling: of the four nearest low resolution texels, prefer
+	//those with a similar circle of confusion, so blur does not leak across edges
+	ivec2 size = textureSize(blurred, 0);
+	vec2 position = texCoord*vec2(size) - 0.5f;
+	ivec2 base = ivec2(floor(position));
+	vec2 f = position - vec2(base);
+
+	vec3 sum = vec3(0.0f);
+	float weight = 0.0f;
+	for (int y=0; y<2; ++y) {
+		for (int x=0; x<2; ++x) {
+			vec4 s = texelFetch(blurred, clamp(base + ivec2(x, y), ivec2(0), size - 1), 0);
+			float bilinear = (x == 0 ? 1.0f - f.x : f.x) * (y == 0 ? 1.0f - f.y : f.y);
+			float w = bilinear / (1e-3f + abs(s.a - coc));
+			sum += w*s.rgb;
+			weight += w;
+		}
+	}
+	vec3 blurred_color = sum / max(weight, 1e-6f);
+
+	//Circles below a pixel stay sharp, and the blur takes over by two pixels
+	vec4 sharp = texture(my_texture, texCoord);
+	float blend = smoothstep(0.5f, 2.0f, abs(coc)*max_coc);
+	out_color = vec4(mix(sharp.rgb, blurred_color, blend), sharp.a);
+}
@@ -0,0 +1,33 @@
+#version 150
+
+uniform sampler2D my_texture; //< Downsampled scene, with the signed circle of confusion in alpha
+uniform vec2 texel; //< Size of one texel of my_texture
+uniform float max_radius; //< Largest circle of confusion, in texels of my_texture
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+const int samples = 32;
+const float golden_angle = 2.39996323f;
+
+void main() {
+	vec4 center = texture(my_texture, texCoord);
+	vec3 sum = center.rgb;
+	float weight = 1.0f;
+
+	//Gather from a disk as large as the largest circle of confusion. A sample
+	//counts if its own circle reaches this pixel, so blurred foreground spreads
+	//over what is behind it. Samples behind the pixel are limited to the pixel's
+	//own circle, so the background does not bleed over sharp objects.
+	for (int i=1; i<samples; ++i) {
+		float r = sqrt(float(i) / float(samples)) * max_radius;
+		float angle = float(i) * golden_angle;
+		vec4 s = texture(my_texture, texCoord + r*vec2(cos(angle), sin(angle))*texel);
+
+		float coc = (s.a < 0.0f) ? -s.a : min(s.a, abs(center.a));
+		float w = clamp(coc*max_radius - r + 1.0f, 0.0f, 1.0f);
+		sum += w*s.rgb;
+		weight += w;
+	}
+
+	out_color = vec4(sum / weight, center.a);
+}
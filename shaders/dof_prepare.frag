@@ -0,0 +1,24 @@
+#version 150
+
+uniform sampler2D my_texture; //< Scene, with mipmaps for the downsampling
+uniform sampler2D depth;
+uniform float z_near;
+uniform float z_far;
+uniform float aperture; //< Circle of confusion, relative to max_coc, of a point at twice the focus distance
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+float linearDepth(float d) {
+	return 2.0f*z_near*z_far / (z_far + z_near - (2.0f*d - 1.0f)*(z_far - z_near));
+}
+
+void main() {
+	//Focus on whatever is in the middle of the screen
+	float focus = linearDepth(texelFetch(depth, textureSize(depth, 0)/2, 0).x);
+	float z = linearDepth(texture(depth, texCoord).x);
+
+	//Signed circle of confusion, negative in front of the focus plane
+	float coc = clamp(aperture*(1.0f - focus/z), -1.0f, 1.0f);
+
+	out_color = vec4(texture(my_texture, texCoord).rgb, coc);
+}
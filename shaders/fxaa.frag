@@ -0,0 +1,47 @@
+#version 150
+
+uniform sampler2D my_texture;
+uniform vec2 texel; //< Size of one texel of my_texture
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+const float edge_threshold = 1.0f/8.0f; //< Local contrast, relative to the brightest neighbour, that counts as an edge
+const float edge_threshold_min = 1.0f/16.0f; //< Ignore edges in the dark
+const float reduce_min = 1.0f/128.0f;
+const float reduce_mul = 1.0f/8.0f;
+const float span_max = 8.0f; //< Longest blur along an edge, in texels
+
+float luma(vec3 color) {
+	return dot(color, vec3(0.299f, 0.587f, 0.114f));
+}
+
+void main() {
+	vec4 center = texture(my_texture, texCoord);
+	float l_nw = luma(texture(my_texture, texCoord + vec2(-1.0f, -1.0f)*texel).rgb);
+	float l_ne = luma(texture(my_texture, texCoord + vec2( 1.0f, -1.0f)*texel).rgb);
+	float l_sw = luma(texture(my_texture, texCoord + vec2(-1.0f,  1.0f)*texel).rgb);
+	float l_se = luma(texture(my_texture, texCoord + vec2( 1.0f,  1.0f)*texel).rgb);
+	float l_m = luma(center.rgb);
+
+	float l_min = min(l_m, min(min(l_nw, l_ne), min(l_sw, l_se)));
+	float l_max = max(l_m, max(max(l_nw, l_ne), max(l_sw, l_se)));
+	if (l_max - l_min < max(edge_threshold_min, l_max*edge_threshold)) {
+		out_color = center;
+		return;
+	}
+
+	//Blur along the edge, which runs across the luminance gradient
+	vec2 direction = vec2(-((l_nw + l_ne) - (l_sw + l_se)), (l_nw + l_sw) - (l_ne + l_se));
+	float reduce = max((l_nw + l_ne + l_sw + l_se)*0.25f*reduce_mul, reduce_min);
+	float scale = 1.0f / (min(abs(direction.x), abs(direction.y)) + reduce);
+	direction = clamp(direction*scale, -span_max, span_max) * texel;
+
+	vec3 a = 0.5f*(texture(my_texture, texCoord + direction*(1.0f/3.0f - 0.5f)).rgb
+			+ texture(my_texture, texCoord + direction*(2.0f/3.0f - 0.5f)).rgb);
+	vec3 b = 0.5f*a + 0.25f*(texture(my_texture, texCoord - 0.5f*direction).rgb
+			+ texture(my_texture, texCoord + 0.5f*direction).rgb);
+
+	//The wider blur is only kept if it did not cross into another edge
+	float l_b = luma(b);
+	out_color = vec4((l_b < l_min || l_b > l_max) ? a : b, center.a);
+}
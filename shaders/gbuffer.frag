@@ -0,0 +1,14 @@
+#version 150
+#extension GL_ARB_explicit_attrib_location : require
+smooth in vec3 normal_smooth;
+
+layout(location = 0) out vec4 out_normal; //< View space normal, and the luminance key phong_os.frag writes to alpha
+layout(location = 1) out vec4 out_material; //< Diffuse colour, and specular intensity
+
+void main() {
+	const vec3 color = vec3(0.5f, 0.7f, 0.5f);
+	float Y = pow(dot(vec3(0.30, 0.59, 0.11), color), 5);
+
+	out_normal = vec4(normalize(normal_smooth), Y);
+	out_material = vec4(color, 1.0f);
+}
@@ -0,0 +1,16 @@
+#version 150
+uniform mat4 projection_matrix;
+uniform mat4 modelview_matrix;
+uniform mat4 modelview_inverse_matrix;
+
+in  vec3 position;
+in  vec3 normal;
+
+smooth out vec3 normal_smooth;
+
+void main() {
+	gl_Position = projection_matrix * modelview_matrix * vec4(position, 1.0);
+
+	//Normals go to view space with the inverse transpose of the modelview matrix
+	normal_smooth = transpose(mat3(modelview_inverse_matrix)) * normal;
+}
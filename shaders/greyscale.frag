@@ -7,8 +7,9 @@ smooth in vec2 texCoord;
 void main() {
 	out_color = texture2D(my_texture, texCoord);
 
-	//Find the average out_color from all the colors and sets the avg value it to all the color channels to get a grey color value
-	float avg = (out_color.x +  out_color.y  +  out_color.z) /3;
+	//Weight the colors by how bright they appear (Rec. 709 luminance), and set
+	//the luminance on all the color channels to get a grey color value
+	float luminance = dot(out_color.rgb, vec3(0.2126, 0.7152, 0.0722));
 
-    out_color = vec4(vec3(avg), 1.0);    
+    out_color = vec4(vec3(luminance), 1.0);    
 }
\ No newline at end of file
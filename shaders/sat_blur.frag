@@ -0,0 +1,38 @@
+#version 150
+
+uniform usampler2D table; //< Summed-area table of the source, the size of the target
+uniform sampler2D depth;
+uniform float z_near;
+uniform float z_far;
+uniform float aperture; //< Radius, relative to max_radius, at twice the focus distance
+uniform float max_radius; //< In pixels
+uniform float scale; //< Of the fixed point sums
+out vec4 out_color;
+
+float linearDepth(float d) {
+	return 2.0f*z_near*z_far / (z_far + z_near - (2.0f*d - 1.0f)*(z_far - z_near));
+}
+
+//Sum from the origin up to and including p, zero outside the table
+uvec4 sumTo(ivec2 p) {
+	return (p.x < 0 || p.y < 0) ? uvec4(0) : texelFetch(table, p, 0);
+}
+
+void main() {
+	ivec2 size = textureSize(table, 0);
+	ivec2 p = ivec2(gl_FragCoord.xy);
+
+	//The radius grows with the distance from the focus, in the middle of the screen
+	float focus = linearDepth(texelFetch(depth, size/2, 0).x);
+	float z = linearDepth(texelFetch(depth, p, 0).x);
+	int radius = int(max_radius*clamp(aperture*abs(1.0f - focus/z), 0.0f, 1.0f) + 0.5f);
+
+	//Four fetches for a box of any size, cut off at the edges of the image.
+	//The sums wrap around, but the difference is exact as long as it fits.
+	ivec2 lo = max(p - radius - 1, ivec2(-1));
+	ivec2 hi = min(p + radius, size - 1);
+	uvec4 sum = sumTo(hi) - sumTo(ivec2(lo.x, hi.y)) - sumTo(ivec2(hi.x, lo.y)) + sumTo(lo);
+	float area = float((hi.x - lo.x)*(hi.y - lo.y));
+
+	out_color = vec4(vec3(sum.rgb) / (scale*area), 1.0f);
+}
@@ -0,0 +1,53 @@
+#version 150
+
+uniform sampler2D my_texture; //< Vertically blurred scene, downscaled
+uniform sampler2D history; //< Last result, with its linear depth in alpha
+uniform sampler2D depth; //< Depth of the scene
+uniform mat4 inverse_projection;
+uniform mat4 reprojection; //< From view space to the clip space of the history
+uniform float dx;
+uniform int history_valid;
+uniform int refresh_phase; //< Which tiles are blurred afresh this frame
+uniform int refresh_period;
+uniform float depth_tolerance; //< Largest relative depth difference of the same surface
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+//Whole tiles are refreshed, so that neighbouring pixels take the same branch
+const int tile_size = 8;
+
+vec3 blurHorizontally() {
+	const float weights[6] = float[](	0.382925f,	0.24173f,	0.060598f,	0.005977f,	0.000229f,	0.000003f);
+
+	vec3 color = weights[0] * texture(my_texture, texCoord).rgb;
+	for (int i = 1; i <= 5; ++i) {
+		color += weights[i] * texture(my_texture, vec2(texCoord.x-i*dx, texCoord.y)).rgb;
+		color += weights[i] * texture(my_texture, vec2(texCoord.x+i*dx, texCoord.y)).rgb;
+	}
+	return color;
+}
+
+void main() {
+	//Position of the pixel in view space
+	vec4 ndc = vec4(vec3(texCoord, texture(depth, texCoord).r)*2.0 - 1.0, 1.0);
+	vec4 position = inverse_projection * ndc;
+	position /= position.w;
+	float linear_depth = -position.z;
+
+	ivec2 tile = ivec2(gl_FragCoord.xy) / tile_size;
+	bool refresh = (history_valid == 0) || ((tile.x + tile.y + refresh_phase) % refresh_period == 0);
+	if (!refresh) {
+		//Where the surface was last frame. Its depth there tells whether
+		//the history saw the same surface, or something now moved away.
+		vec4 previous = reprojection * position;
+		vec2 uv = (previous.xy / previous.w)*0.5 + 0.5;
+		vec4 old = texture(history, uv);
+		bool inside = all(greaterThanEqual(uv, vec2(0.0))) && all(lessThanEqual(uv, vec2(1.0)));
+		if (inside && abs(old.a - previous.w) <= depth_tolerance*previous.w) {
+			out_color = vec4(old.rgb, linear_depth);
+			return;
+		}
+	}
+
+	out_color = vec4(blurHorizontally(), linear_depth);
+}
@@ -0,0 +1,10 @@
+#version 150
+
+uniform sampler2D my_texture;
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+void main() {
+	//The history keeps depth in alpha, which must not reach the output
+	out_color = vec4(texture(my_texture, texCoord).rgb, 1.0);
+}
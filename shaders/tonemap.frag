@@ -0,0 +1,19 @@
+#version 150
+
+//Exposes the scene so its average luminance maps to the key value,
+//and compresses the result into [0, 1] with Reinhard's operator
+uniform sampler2D my_texture;
+uniform sampler2D average_luminance; //1x1, written by luminance_average.comp
+uniform float key;
+out vec4 out_color;
+smooth in vec2 texCoord;
+
+void main() {
+	vec3 color = texture(my_texture, texCoord).rgb;
+	float average = max(texelFetch(average_luminance, ivec2(0), 0).r, 0.0001);
+	vec3 exposed = color * (key / average);
+
+	//Scale by the luminance only, so the hue is kept
+	float luminance = dot(exposed, vec3(0.2126, 0.7152, 0.0722));
+	out_color = vec4(exposed / (1.0 + luminance), 1.0);
+}
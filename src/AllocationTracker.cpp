@@ -0,0 +1,141 @@
+#include "AllocationTracker.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+struct Scope {
+	const char* name;
+	AllocationStats stats;
+};
+
+/**
+ * Per thread state. Plain data, so it is zero initialised without
+ * running a constructor, and is safe to use from operator new.
+ */
+struct ThreadState {
+	bool enabled;
+	const char* scope; //< Innermost AllocationScope, or NULL
+	AllocationStats total;
+	Scope scopes[AllocationTracker::max_scopes];
+	unsigned int n_scopes;
+};
+
+thread_local ThreadState state;
+
+}
+
+void AllocationTracker::setEnabled(bool enabled) {
+	state.enabled = enabled;
+}
+
+bool AllocationTracker::isEnabled() {
+	return state.enabled;
+}
+
+AllocationStats AllocationTracker::getTotal() {
+	return state.total;
+}
+
+void AllocationTracker::reset() {
+	state.total.count = 0;
+	state.total.bytes = 0;
+	state.n_scopes = 0;
+}
+
+void AllocationTracker::record(size_t bytes) {
+	if (!state.enabled) return;
+	++state.total.count;
+	state.total.bytes += bytes;
+
+	const char* name = (state.scope != NULL) ? state.scope : "unscoped";
+	for (unsigned int i=0; i<state.n_scopes; ++i) {
+		if (state.scopes[i].name == name) {
+			++state.scopes[i].stats.count;
+			state.scopes[i].stats.bytes += bytes;
+			return;
+		}
+	}
+	if (state.n_scopes == max_scopes) return;
+	Scope& scope = state.scopes[state.n_scopes++];
+	scope.name = name;
+	scope.stats.count = 1;
+	scope.stats.bytes = bytes;
+}
+
+void AllocationTracker::report(std::ostream& out, unsigned int frames) {
+	//Writing to the stream may allocate, so do not count that
+	const bool enabled = state.enabled;
+	state.enabled = false;
+
+	const double n = (frames > 0) ? frames : 1;
+	out << "Allocations per frame over " << frames << " frames: " << state.total.count / n
+		<< " (" << state.total.bytes / n << " bytes)" << std::endl;
+	for (unsigned int i=0; i<state.n_scopes; ++i)
+		out << "  " << state.scopes[i].name << ": " << state.scopes[i].stats.count / n
+			<< " (" << state.scopes[i].stats.bytes / n << " bytes)" << std::endl;
+
+	state.enabled = enabled;
+}
+
+AllocationScope::AllocationScope(const char* name) {
+	previous = state.scope;
+	state.scope = name;
+}
+
+AllocationScope::~AllocationScope() {
+	state.scope = previous;
+}
+
+//Replacements of the global allocation functions. Everything else
+//(nothrow and array forms) is routed through the first one.
+void* operator new(std::size_t bytes) {
+	AllocationTracker::record(bytes);
+	if (bytes == 0) bytes = 1;
+	while (true) {
+		void* p = std::malloc(bytes);
+		if (p != NULL) return p;
+		std::new_handler handler = std::get_new_handler();
+		if (handler == NULL) throw std::bad_alloc();
+		handler();
+	}
+}
+
+void* operator new[](std::size_t bytes) {
+	return operator new(bytes);
+}
+
+void* operator new(std::size_t bytes, const std::nothrow_t&) noexcept {
+	try {
+		return operator new(bytes);
+	}
+	catch (...) {
+		return NULL;
+	}
+}
+
+void* operator new[](std::size_t bytes, const std::nothrow_t&) noexcept {
+	try {
+		return operator new(bytes);
+	}
+	catch (...) {
+		return NULL;
+	}
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
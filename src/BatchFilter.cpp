@@ -0,0 +1,303 @@
+#include "BatchFilter.h"
+#include "GameException.h"
+#include "GLUtils/GLUtils.hpp"
+#include "ImageIO.h"
+#include "ResourceRegistry.h"
+#include "Tracer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#endif
+
+namespace {
+	bool hasImageExtension(const std::string& filename) {
+		std::string::size_type dot = filename.find_last_of('.');
+		if (dot == std::string::npos) return false;
+		std::string extension = filename.substr(dot+1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		return extension == "ppm" || extension == "pgm" || extension == "pnm";
+	}
+
+	/**
+	 * Returns the image files in directory, sorted by name
+	 */
+	std::vector<std::string> listImages(const std::string& directory) {
+		std::vector<std::string> files;
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE handle = FindFirstFileA((directory + "\\*").c_str(), &data);
+		if (handle == INVALID_HANDLE_VALUE) THROW_EXCEPTION("Could not open " + directory);
+		do {
+			if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && hasImageExtension(data.cFileName))
+				files.push_back(directory + "/" + data.cFileName);
+		} while (FindNextFileA(handle, &data));
+		FindClose(handle);
+#else
+		DIR* dir = opendir(directory.c_str());
+		if (dir == NULL) THROW_EXCEPTION("Could not open " + directory);
+		while (dirent* entry = readdir(dir)) {
+			if (hasImageExtension(entry->d_name))
+				files.push_back(directory + "/" + entry->d_name);
+		}
+		closedir(dir);
+#endif
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	/**
+	 * Strips the directory and extension of filename
+	 */
+	std::string baseName(const std::string& filename) {
+		std::string::size_type slash = filename.find_last_of("/\\");
+		std::string name = (slash == std::string::npos) ? filename : filename.substr(slash+1);
+		return name.substr(0, name.find_last_of('.'));
+	}
+}
+
+BatchFilter::BatchFilter(const std::string& input_dir, const std::string& output_dir, unsigned int workers)
+		: decoded(queue_size), encoded(queue_size) {
+	this->output_dir = output_dir;
+	inputs = listImages(input_dir);
+	next_input = 0;
+	upload_head = 0;
+	readback_head = 0;
+	in_flight = 0;
+	images_written = 0;
+	images_failed = 0;
+	finished = false;
+
+	ResourceScope scope("BatchFilter");
+	glGenBuffers(ring_size, upload_pbos);
+	glGenBuffers(ring_size, readback_pbos);
+	for (unsigned int i=0; i<ring_size; ++i) {
+		upload_capacity[i] = 0;
+		readback_capacity[i] = 0;
+		upload_fences[i] = 0;
+		readback_fences[i] = 0;
+	}
+	CHECK_GL_ERRORS();
+
+	if (workers == 0) workers = std::max(2u, std::thread::hardware_concurrency());
+	const unsigned int n_decoders = std::max(1u, workers / 2);
+	const unsigned int n_encoders = std::max(1u, workers - n_decoders);
+
+	start = std::chrono::steady_clock::now();
+	decoders_running = n_decoders;
+	for (unsigned int i=0; i<n_decoders; ++i)
+		decoders.push_back(std::thread(&BatchFilter::decoderLoop, this));
+	for (unsigned int i=0; i<n_encoders; ++i)
+		encoders.push_back(std::thread(&BatchFilter::encoderLoop, this));
+
+	std::cout << "Filtering " << inputs.size() << " images with " << n_decoders << " decoders and "
+		<< n_encoders << " encoders" << std::endl;
+}
+
+BatchFilter::~BatchFilter() {
+	finish();
+}
+
+void BatchFilter::finish() {
+	if (finished) return;
+	finished = true;
+
+	//Stop the decoders, in case the caller stopped early
+	decoded.close();
+	for (unsigned int i=0; i<decoders.size(); ++i)
+		decoders[i].join();
+
+	//Drain the GPU side, then let the encoders finish the queue
+	while (in_flight > 0)
+		retire(true);
+	encoded.close();
+	for (unsigned int i=0; i<encoders.size(); ++i)
+		encoders[i].join();
+
+	for (unsigned int i=0; i<ring_size; ++i) {
+		if (upload_fences[i] != 0) glDeleteSync(upload_fences[i]);
+		ResourceRegistry::remove(RESOURCE_BUFFER, upload_pbos[i]);
+		ResourceRegistry::remove(RESOURCE_BUFFER, readback_pbos[i]);
+	}
+	glDeleteBuffers(ring_size, upload_pbos);
+	glDeleteBuffers(ring_size, readback_pbos);
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Filtered " << images_written << " images to " << output_dir << " in " << seconds << " s ("
+		<< images_written / std::max(seconds, 1e-6) << " images/s, " << images_failed << " failed)" << std::endl;
+}
+
+void BatchFilter::decoderLoop() {
+	Tracer::setThreadName("decoder");
+
+	while (true) {
+		const unsigned int index = next_input++;
+		if (index >= inputs.size()) break;
+
+		Image image;
+		try {
+			TRACE_SCOPE("decode image");
+			ImageIO::readPNM(inputs[index], image.width, image.height, image.pixels);
+		}
+		catch (std::exception& e) {
+			std::cerr << "Skipping " << inputs[index] << ": " << e.what() << std::endl;
+			++images_failed;
+			continue;
+		}
+		image.name = output_dir + "/" + baseName(inputs[index]) + ".png";
+		if (!decoded.push(std::move(image))) break; //Closed by finish()
+	}
+
+	if (--decoders_running == 0)
+		decoded.close();
+}
+
+void BatchFilter::encoderLoop() {
+	Tracer::setThreadName("encoder");
+
+	Image image;
+	while (encoded.pop(image)) {
+		TRACE_SCOPE("encode image");
+		try {
+			//The pixels were uploaded and read back top row first
+			ImageIO::writePNG(image.name, image.width, image.height, &image.pixels[0], false);
+			++images_written;
+		}
+		catch (std::exception& e) {
+			std::cerr << "Writing " << image.name << " failed: " << e.what() << std::endl;
+			++images_failed;
+		}
+	}
+}
+
+bool BatchFilter::next(unsigned int& width, unsigned int& height) {
+	TRACE_SCOPE("wait for image");
+	if (!decoded.pop(current)) return false;
+	width = current.width;
+	height = current.height;
+	return true;
+}
+
+void BatchFilter::reserve(GLenum target, GLuint buffer, size_t& capacity, size_t bytes, GLenum usage) {
+	if (bytes <= capacity) return;
+	ResourceScope scope("BatchFilter");
+	glBufferData(target, bytes, NULL, usage);
+	ResourceRegistry::remove(RESOURCE_BUFFER, buffer);
+	ResourceRegistry::add(RESOURCE_BUFFER, buffer, bytes);
+	capacity = bytes;
+}
+
+void BatchFilter::upload(TextureFBO& target) {
+	const size_t bytes = current.pixels.size();
+	const unsigned int slot = upload_head;
+	upload_head = (upload_head + 1) % ring_size;
+
+	//The buffer was last used ring_size images ago, so its copy
+	//into the texture has normally finished, and this does not wait
+	if (upload_fences[slot] != 0) {
+		GLUtils::waitSync(upload_fences[slot]);
+		glDeleteSync(upload_fences[slot]);
+		upload_fences[slot] = 0;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_pbos[slot]);
+	reserve(GL_PIXEL_UNPACK_BUFFER, upload_pbos[slot], upload_capacity[slot], bytes, GL_STREAM_DRAW);
+	void* data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (data == NULL) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		THROW_EXCEPTION("Could not map the upload buffer");
+	}
+	std::memcpy(data, &current.pixels[0], bytes);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	//The copy into the texture runs asynchronously from the buffer
+	glBindTexture(GL_TEXTURE_2D, target.getTexture());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, current.width, current.height, GL_RGBA, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	upload_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	CHECK_GL_ERRORS();
+
+	//The encoders allocate their own buffers, so free this one early
+	std::vector<unsigned char>().swap(current.pixels);
+}
+
+void BatchFilter::readback(TextureFBO& source) {
+	//Make room in the ring. Unlike FrameCapture, no image may be dropped.
+	if (in_flight == ring_size)
+		retire(true);
+
+	const unsigned int width = source.getWidth();
+	const unsigned int height = source.getHeight();
+	const size_t bytes = static_cast<size_t>(width)*height*4;
+
+	source.bind();
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_pbos[readback_head]);
+	reserve(GL_PIXEL_PACK_BUFFER, readback_pbos[readback_head], readback_capacity[readback_head], bytes, GL_STREAM_READ);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	source.unbind();
+	readback_fences[readback_head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	CHECK_GL_ERRORS();
+
+	pending[readback_head].name = current.name;
+	pending[readback_head].width = width;
+	pending[readback_head].height = height;
+	readback_head = (readback_head + 1) % ring_size;
+	++in_flight;
+
+	//Hand over every image the GPU has already finished
+	while (in_flight > 0 && retire(false));
+}
+
+bool BatchFilter::retire(bool block) {
+	const unsigned int oldest = (readback_head + ring_size - in_flight) % ring_size;
+
+	if (block) {
+		GLUtils::waitSync(readback_fences[oldest]);
+	}
+	else {
+		GLenum status = glClientWaitSync(readback_fences[oldest], 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) return false;
+		if (status == GL_WAIT_FAILED) THROW_EXCEPTION("Waiting for the readback fence failed");
+	}
+	glDeleteSync(readback_fences[oldest]);
+	readback_fences[oldest] = 0;
+	--in_flight;
+
+	Image image;
+	image.name = pending[oldest].name;
+	image.width = pending[oldest].width;
+	image.height = pending[oldest].height;
+	const size_t bytes = static_cast<size_t>(image.width)*image.height*4;
+	image.pixels.resize(bytes);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_pbos[oldest]);
+	const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+	if (data != NULL) {
+		std::memcpy(&image.pixels[0], data, bytes);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	CHECK_GL_ERRORS();
+	if (data == NULL) {
+		std::cerr << "Could not map the result for " << image.name << std::endl;
+		++images_failed;
+		return true;
+	}
+
+	//Waits if the encoders are behind, which holds back the GPU and the decoders too
+	TRACE_SCOPE("wait for encoder");
+	encoded.push(std::move(image));
+	return true;
+}
@@ -0,0 +1,181 @@
+#include "FrameCapture.h"
+#include "GameException.h"
+#include "GLUtils/GLUtils.hpp"
+#include "ResourceRegistry.h"
+#include "Tracer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+FrameCapture::FrameCapture(unsigned int width, unsigned int height, CaptureFormat format,
+		std::string path, unsigned int fps) {
+	this->width = width;
+	this->height = height;
+	this->format = format;
+	this->path = path;
+	head = 0;
+	in_flight = 0;
+	queue_head = 0;
+	queue_count = 0;
+	stopping = false;
+	frames_captured = 0;
+	frames_written = 0;
+	frames_dropped = 0;
+
+	if (format == CAPTURE_Y4M)
+		y4m.reset(new Y4MWriter(path, width, height, fps));
+
+	const unsigned int bytes = width*height*4;
+	for (unsigned int i=0; i<max_queued; ++i)
+		queue[i].pixels.resize(bytes);
+
+	//Create the ring of PBOs, which the driver can place in host visible memory
+	ResourceScope scope("FrameCapture");
+	glGenBuffers(ring_size, pbos);
+	for (unsigned int i=0; i<ring_size; ++i) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+		ResourceRegistry::add(RESOURCE_BUFFER, pbos[i], bytes);
+		fences[i] = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	CHECK_GL_ERRORS();
+
+	writer = std::thread(&FrameCapture::writerLoop, this);
+}
+
+FrameCapture::~FrameCapture() {
+	//Drain the GPU side first, then let the writer finish the queue
+	while (in_flight > 0)
+		retire(true);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	queue_changed.notify_all();
+	writer.join();
+
+	for (unsigned int i=0; i<ring_size; ++i)
+		ResourceRegistry::remove(RESOURCE_BUFFER, pbos[i]);
+	glDeleteBuffers(ring_size, pbos);
+	std::cout << "Captured " << frames_written << " frames to " << path
+		<< " (" << frames_dropped << " dropped)" << std::endl;
+}
+
+void FrameCapture::capture(TextureFBO& source) {
+	//The owner scales the output to the capture size, but a frame of
+	//another size would overrun the buffers
+	if (source.getWidth() != width || source.getHeight() != height) {
+		++frames_dropped;
+		return;
+	}
+
+	//Make room in the ring. With ring_size frames of latency this
+	//normally finds an already signalled fence and does not wait.
+	if (in_flight == ring_size)
+		retire(true);
+
+	//Start an asynchronous read into the PBO at the head of the ring
+	source.bind();
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[head]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	source.unbind();
+	fences[head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	CHECK_GL_ERRORS();
+
+	head = (head + 1) % ring_size;
+	++in_flight;
+	++frames_captured;
+
+	//Hand over every frame the GPU has already finished
+	while (in_flight > 0 && retire(false));
+}
+
+bool FrameCapture::retire(bool block) {
+	unsigned int oldest = (head + ring_size - in_flight) % ring_size;
+
+	GLenum status = glClientWaitSync(fences[oldest], block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+			block ? 1000000000ull : 0);
+	if (status == GL_TIMEOUT_EXPIRED && !block) return false;
+	if (status == GL_WAIT_FAILED) THROW_EXCEPTION("Waiting for the capture fence failed");
+	glDeleteSync(fences[oldest]);
+	fences[oldest] = 0;
+	--in_flight;
+
+	const unsigned int frame_index = frames_captured - in_flight - 1;
+
+	unsigned int slot;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (queue_count == max_queued) {
+			//The writer cannot keep up; drop rather than stall rendering
+			++frames_dropped;
+			return true;
+		}
+		slot = (queue_head + queue_count) % max_queued;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[oldest]);
+	const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, width*height*4, GL_MAP_READ_BIT);
+	if (data != NULL) {
+		std::memcpy(&queue[slot].pixels[0], data, width*height*4);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	CHECK_GL_ERRORS();
+	if (data == NULL) {
+		++frames_dropped;
+		return true;
+	}
+	queue[slot].index = frame_index;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++queue_count;
+	}
+	queue_changed.notify_one();
+	return true;
+}
+
+void FrameCapture::writerLoop() {
+	Tracer::setThreadName("capture writer");
+	char filename[32];
+
+	while (true) {
+		Frame* frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			queue_changed.wait(lock, [this] { return queue_count > 0 || stopping; });
+			if (queue_count == 0) return; //Stopping, and the queue is drained
+			frame = &queue[queue_head];
+		}
+
+		//Encode outside the lock; the render thread never touches the head slot
+		TRACE_SCOPE("write frame");
+		try {
+			if (format == CAPTURE_Y4M) {
+				y4m->writeFrame(&frame->pixels[0]);
+			}
+			else {
+				std::snprintf(filename, sizeof(filename), "_%06u.png", frame->index);
+				//The scene alpha holds the bloom brightness, not opacity
+				ImageIO::writePNG(path + filename, width, height, &frame->pixels[0], true, false);
+			}
+			++frames_written;
+		}
+		catch (std::exception& e) {
+			std::cerr << "Frame capture failed: " << e.what() << std::endl;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue_head = (queue_head + 1) % max_queued;
+			--queue_count;
+		}
+	}
+}
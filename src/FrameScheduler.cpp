@@ -0,0 +1,109 @@
+#include "FrameScheduler.h"
+
+#include <algorithm>
+
+FrameScheduler::FrameScheduler(SchedulerMode mode, double target_fps) {
+	this->mode = mode;
+	frame_begin = 0;
+	frame_count = 0;
+	redraw_requested = true; //Always draw the first frame
+	setTargetRate(target_fps);
+	next_deadline = Timer::getCurrentTimeNs();
+}
+
+FrameScheduler::~FrameScheduler() {
+}
+
+int FrameScheduler::setMode(SchedulerMode mode) {
+	this->mode = mode;
+	redraw_requested = true;
+	next_deadline = Timer::getCurrentTimeNs();
+	return (mode == VSYNC_LOCKED) ? 1 : 0;
+}
+
+const char* FrameScheduler::getModeName(SchedulerMode mode) {
+	switch (mode) {
+	case CONTINUOUS: return "continuous";
+	case VSYNC_LOCKED: return "vsync";
+	case FIXED_RATE: return "fixed rate";
+	case ON_DEMAND: return "on demand";
+	default: return "unknown";
+	}
+}
+
+void FrameScheduler::setTargetRate(double fps) {
+	frame_period = static_cast<uint64_t>(1e9 / std::max(fps, 1.0));
+}
+
+int FrameScheduler::getWaitTimeout() const {
+	switch (mode) {
+	case ON_DEMAND:
+		return (redraw_requested) ? 0 : -1;
+
+	case FIXED_RATE: {
+		uint64_t now = Timer::getCurrentTimeNs();
+		if (now >= next_deadline) return 0;
+		//Round down, so that we wake up early rather than late
+		int ms = static_cast<int>((next_deadline - now) / 1000000);
+		return std::max(ms, 1);
+	}
+
+	case CONTINUOUS:
+	case VSYNC_LOCKED:
+	default:
+		return 0;
+	}
+}
+
+bool FrameScheduler::shouldRender() const {
+	switch (mode) {
+	case ON_DEMAND:
+		return redraw_requested;
+	case FIXED_RATE:
+		return Timer::getCurrentTimeNs() >= next_deadline;
+	case CONTINUOUS:
+	case VSYNC_LOCKED:
+	default:
+		return true;
+	}
+}
+
+void FrameScheduler::beginFrame() {
+	frame_begin = Timer::getCurrentTimeNs();
+	redraw_requested = false;
+
+	if (mode == FIXED_RATE) {
+		//Advance the deadline, but do not try to catch up on frames we missed
+		next_deadline += frame_period;
+		if (next_deadline < frame_begin) next_deadline = frame_begin + frame_period;
+	}
+}
+
+void FrameScheduler::endFrame() {
+	frame_times[frame_count % history_size] = Timer::getCurrentTimeNs() - frame_begin;
+	++frame_count;
+}
+
+FrameStats FrameScheduler::getStats() const {
+	FrameStats stats;
+	stats.frames = frame_count;
+	if (frame_count == 0) return stats;
+
+	unsigned int n = static_cast<unsigned int>(std::min<uint64_t>(frame_count, history_size));
+	uint64_t sorted[history_size];
+	uint64_t sum = 0;
+	for (unsigned int i=0; i<n; ++i) {
+		sorted[i] = frame_times[i];
+		sum += frame_times[i];
+	}
+	std::sort(sorted, sorted+n);
+
+	stats.last = frame_times[(frame_count-1) % history_size]*1e-6;
+	stats.mean = (sum / static_cast<double>(n))*1e-6;
+	stats.min = sorted[0]*1e-6;
+	stats.max = sorted[n-1]*1e-6;
+	stats.p50 = sorted[(n-1)*50/100]*1e-6;
+	stats.p95 = sorted[(n-1)*95/100]*1e-6;
+	stats.p99 = sorted[(n-1)*99/100]*1e-6;
+	return stats;
+}
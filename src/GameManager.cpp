@@ -6,8 +6,16 @@
 #include <vector>
 #include <assert.h>
 #include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <random>
 
+#include "BlurKernel.h"
 #include "GLUtils/GLUtils.hpp"
+#include "ResourceRegistry.h"
+#include "Tracer.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -19,6 +27,37 @@ using GLUtils::BO;
 using GLUtils::Program;
 using GLUtils::readFile;
 
+namespace {
+	//Metered luminance range, in stops, and the middle grey it is exposed to
+	const float min_log_luminance = -10.0f;
+	const float log_luminance_range = 12.0f;
+	const float exposure_key = 0.18f;
+	const float adaptation_time = 0.5f; //< Time constant of the eye adaptation, in seconds
+	const unsigned int histogram_bins = 256;
+	const unsigned int max_metered_samples = 1u << 20;
+
+	const unsigned int separable_blur_tile = 128; //< Texels per workgroup of separable_blur.comp
+
+	const float variable_blur_max_radius = 32.0f; //< In pixels, so the boxes fit SummedAreaTable::max_box_pixels
+
+	//The temporal blur refreshes one tile in this many each frame, and
+	//rejects history whose depth differs by more than the tolerance
+	const unsigned int temporal_refresh_period = 4;
+	const float temporal_depth_tolerance = 0.05f;
+
+	const float replay_timestep = 1.0f / 60.0f; //< Seconds per frame when replaying input
+
+	//The clip planes of projection_matrix
+	const float z_near = 1.0f;
+	const float z_far = 10.0f;
+
+	const float dof_aperture = 1.0f; //< Circle of confusion, relative to dof_max_coc, at twice the focus distance
+	const float dof_max_coc = 16.0f; //< Largest circle of confusion, in pixels of the scene
+
+	const float bloom_threshold = 0.1f; //< Brightness mask, in the scene alpha, where the glow starts
+	const float bloom_intensity = 0.3f; //< Of the sum of the pyramid levels
+}
+
 //Vertices to render a quad
 GLfloat GameManager::quad_vertices[] =  {
 	-1.f, -1.f,
@@ -33,23 +72,129 @@ GLubyte GameManager::quad_indices[] = {
 	2, 3, 0, //triangle 2
 };
 
-unsigned int GameManager::downscale_level = 4;
-
 GameManager::GameManager() {
 	my_timer.restart();
+	main_window = NULL;
+	main_context = NULL;
+	running = false;
+	resize_pending = false;
+	resize_deadline = 0;
+	max_target_size = 16384;
+	compute_supported = false;
+	msaa_samples = 0;
+	compute_blur = false;
+	motion_events = 0;
+	trackball_updates = 0;
+
+	window_width = 800;
+	window_height = 600;
+	downscale_level = 4;
+	dof_downscale_level = 1;
+	render_scale = 1.0f;
+	range_sigma = 0.1f;
+	metered_fingerprint = 0;
+	recursive_sigma = 0.0f;
+	track_allocations = false;
+	tracked_frames = 0;
+	exposure_settle_deadline = 0;
+	history_index = 0;
+	history_valid = false;
+	temporal_frame = 0;
+	temporal_refresh_frames = 0;
+	frame_index = 0;
+	print_statistics = false;
+	pass_coverage = 1.0f;
+	deferred_shading = false;
+	light_count = 256;
+	for (unsigned int i=0; i<3; ++i)
+		light_textures[i] = 0;
 	
 	//Setts the render mode to standar phong shading 
 	filterMode = RenderMode::STANDARD;
-
+	antialiasing = ANTIALIAS_NONE;
 }
 
 GameManager::~GameManager() {
+	if (!main_context) return;
+
+	//Release every GL object while the context is still alive
+	SDL_GL_MakeCurrent(main_window, main_context);
+	capture.reset();
+	capture_fbo.reset();
+	profiler.reset();
+	fbo1.reset();
+	msaa_fbo.reset();
+	fxaa_fbo.reset();
+	fbo2.reset();
+	greyscale_fbo.reset();
+	blur_fbo.reset();
+	for (unsigned int i=0; i<2; ++i)
+		grid_fbos[i].reset();
+	exposure_fbo.reset();
+	for (unsigned int i=0; i<2; ++i)
+		history_fbos[i].reset();
+	gbuffer.reset();
+	summed_area_table.reset();
+	for (unsigned int i=0; i<2; ++i)
+		dof_fbos[i].reset();
+	for (unsigned int i=0; i<bloom_levels; ++i)
+		bloom_fbos[i].reset();
+	target_pool.clear();
+	histogram_buffer.reset();
+	for (unsigned int i=0; i<3; ++i)
+		ResourceRegistry::remove(RESOURCE_TEXTURE, light_textures[i]);
+	glDeleteTextures(3, light_textures);
+	light_buffer.reset();
+	cluster_buffer.reset();
+	light_index_buffer.reset();
+	model.reset();
+	vertices.reset();
+	indices.reset();
+	for (unsigned int i=0; i<max_vaos; ++i)
+		ResourceRegistry::remove(RESOURCE_VERTEX_ARRAY, vaos[i]);
+	glDeleteVertexArrays(max_vaos, vaos);
+
+	phong_program.reset();
+	passthrough_program.reset();
+	horizontal_blur_program.reset();
+	vertical_blur_program.reset();
+	greyscale_program.reset();
+	recursive_blur_program.reset();
+	box_blur_program.reset();
+	bilateral_splat_program.reset();
+	bilateral_blur_program.reset();
+	bilateral_slice_program.reset();
+	luminance_histogram_program.reset();
+	luminance_average_program.reset();
+	tonemap_program.reset();
+	temporal_blur_program.reset();
+	temporal_upsample_program.reset();
+	gbuffer_program.reset();
+	deferred_lighting_program.reset();
+	dof_prepare_program.reset();
+	dof_gather_program.reset();
+	dof_composite_program.reset();
+	bloom_bright_program.reset();
+	bloom_downsample_program.reset();
+	bloom_upsample_program.reset();
+	bloom_composite_program.reset();
+	fxaa_program.reset();
+	separable_blur_program.reset();
+	sat_scan_program.reset();
+	sat_blur_program.reset();
+
+	ResourceRegistry::reportLeaks(std::cerr);
+	SDL_GL_DeleteContext(main_context);
+	SDL_DestroyWindow(main_window);
 }
 
-void GameManager::createOpenGLContext() {
-	//Set OpenGL major an minor versions
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+void GameManager::createOpenGLContext(bool hidden) {
+	TRACE_SCOPE("createOpenGLContext");
+	//Set OpenGL major an minor versions. Ask for 4.3 first, for compute
+	//shaders, and fall back to 3.3 below if that fails.
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_COMPATIBILITY);
 
 	// Set OpenGL attributes
 	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1); // Use double buffering
@@ -58,18 +203,29 @@ void GameManager::createOpenGLContext() {
 	SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8); // Use framebuffer with 8 bit for green
 	SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8); // Use framebuffer with 8 bit for blue
 	SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8); // Use framebuffer with 8 bit for alpha
-	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
+	//No multisampling here: only a full screen quad is drawn to the window, and
+	//the scene is multisampled in its own target instead
 
 	// Initalize video
 	main_window = SDL_CreateWindow("Westerdals - PG6200 Example OpenGL Program", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-		window_width, window_height, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
+		window_width, window_height, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | (hidden ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN));
 	if (!main_window) {
 		THROW_EXCEPTION("SDL_CreateWindow failed");
 	}
 
 	//Create OpenGL context
 	main_context = SDL_GL_CreateContext(main_window);
+	if (!main_context) {
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, 0);
+		main_context = SDL_GL_CreateContext(main_window);
+	}
+	if (!main_context) {
+		std::stringstream err;
+		err << "SDL_GL_CreateContext failed: " << SDL_GetError();
+		THROW_EXCEPTION(err.str());
+	}
 	trackball.setWindowSize(window_width, window_height);
 
 	// Init glew
@@ -87,6 +243,30 @@ void GameManager::createOpenGLContext() {
 	// supposed to (setting function pointers for core functionality).
 	// Lets do the ugly thing of swallowing the error....
 	glGetError();
+
+	//Targets larger than this cannot be allocated
+	GLint max_texture_size, max_viewport_dims[2];
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport_dims);
+	max_target_size = std::min(max_texture_size, std::min(max_viewport_dims[0], max_viewport_dims[1]));
+
+	//The multisampled scene target has float colour, and depth
+	GLint max_color_samples, max_depth_samples;
+	glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &max_color_samples);
+	glGetIntegerv(GL_MAX_DEPTH_TEXTURE_SAMPLES, &max_depth_samples);
+	msaa_samples = std::max(0, std::min(4, std::min(max_color_samples, max_depth_samples)));
+	if (antialiasing == ANTIALIAS_MSAA && msaa_samples < 2) {
+		cerr << "Multisampled targets not supported, rendering without antialiasing" << endl;
+		antialiasing = ANTIALIAS_NONE;
+	}
+
+	compute_supported = (GLEW_VERSION_4_3 == GL_TRUE);
+	if (!compute_supported)
+		cerr << "OpenGL 4.3 not available, the recursive and box blurs fall back to the downscaled blur" << endl;
+	if (!compute_supported && compute_blur) {
+		cerr << "OpenGL 4.3 not available, blurring in fragment shaders" << endl;
+		compute_blur = false;
+	}
 }
 
 void GameManager::setOpenGLStates() {
@@ -99,43 +279,226 @@ void GameManager::setOpenGLStates() {
 }
 
 void GameManager::createMatrices() {
-	projection_matrix = glm::perspective(45.0f,
-			window_width / (float) window_height, 1.0f, 10.f);
+	//The projection depends on the window size, see setSizeDependentUniforms
 	model_matrix = glm::scale(glm::mat4(1.0f), glm::vec3(3));
 	view_matrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -5.0f));
 }
 
 void GameManager::createSimpleProgram() {
+	TRACE_SCOPE("createSimpleProgram");
+	ResourceScope scope("createSimpleProgram");
 	//Compile shaders, attach to program object, and link
 	phong_program.reset(new Program("shaders/phong_os.vert", "shaders/phong_os.frag"));
 	passthrough_program.reset(new Program("shaders/passthrough.vert", "shaders/passthrough.frag"));
 	horizontal_blur_program.reset(new Program("shaders/passthrough.vert","shaders/horizontal_blur.frag"));
 	vertical_blur_program.reset(new Program("shaders/passthrough.vert","shaders/vertical_blur.frag"));
 	greyscale_program.reset(new Program("shaders/passthrough.vert","shaders/greyscale.frag"));
+	bilateral_splat_program.reset(new Program("shaders/bilateral_splat.vert", "shaders/bilateral_splat.geom", "shaders/bilateral_splat.frag"));
+	bilateral_blur_program.reset(new Program("shaders/bilateral_blur.vert", "shaders/bilateral_blur.geom", "shaders/bilateral_blur.frag"));
+	bilateral_slice_program.reset(new Program("shaders/passthrough.vert", "shaders/bilateral_slice.frag"));
+	if (compute_supported) {
+		recursive_blur_program.reset(new Program("shaders/recursive_blur.comp"));
+		box_blur_program.reset(new Program("shaders/box_blur.comp"));
+		separable_blur_program.reset(new Program("shaders/separable_blur.comp"));
+		sat_scan_program.reset(new Program("shaders/sat_scan.comp"));
+		luminance_histogram_program.reset(new Program("shaders/luminance_histogram.comp"));
+		luminance_average_program.reset(new Program("shaders/luminance_average.comp"));
+	}
+	tonemap_program.reset(new Program("shaders/passthrough.vert", "shaders/tonemap.frag"));
+	temporal_blur_program.reset(new Program("shaders/passthrough.vert", "shaders/temporal_blur.frag"));
+	temporal_upsample_program.reset(new Program("shaders/passthrough.vert", "shaders/temporal_upsample.frag"));
+	gbuffer_program.reset(new Program("shaders/gbuffer.vert", "shaders/gbuffer.frag"));
+	deferred_lighting_program.reset(new Program("shaders/passthrough.vert", "shaders/deferred_lighting.frag"));
+	dof_prepare_program.reset(new Program("shaders/passthrough.vert", "shaders/dof_prepare.frag"));
+	dof_gather_program.reset(new Program("shaders/passthrough.vert", "shaders/dof_gather.frag"));
+	dof_composite_program.reset(new Program("shaders/passthrough.vert", "shaders/dof_composite.frag"));
+	bloom_bright_program.reset(new Program("shaders/passthrough.vert", "shaders/bloom_bright.frag"));
+	bloom_downsample_program.reset(new Program("shaders/passthrough.vert", "shaders/bloom_downsample.frag"));
+	bloom_upsample_program.reset(new Program("shaders/passthrough.vert", "shaders/bloom_upsample.frag"));
+	bloom_composite_program.reset(new Program("shaders/passthrough.vert", "shaders/bloom_composite.frag"));
+	fxaa_program.reset(new Program("shaders/passthrough.vert", "shaders/fxaa.frag"));
+	sat_blur_program.reset(new Program("shaders/passthrough.vert", "shaders/sat_blur.frag"));
 	CHECK_GL_ERRORS();
 
 	//Set uniforms for the programs
-	phong_program->use();
-	glUniformMatrix4fv(phong_program->getUniform("projection_matrix"), 1, 0, glm::value_ptr(projection_matrix));
-	phong_program->disuse();
-	CHECK_GL_ERRORS();
-	
 	passthrough_program->use();
 	glUniform1i(passthrough_program->getUniform("my_texture"), 0);
 
 	horizontal_blur_program->use();
 	glUniform1i(horizontal_blur_program->getUniform("my_texture"), 0);
-	glUniform1f(horizontal_blur_program->getUniform("dx"), 1.0f / fbo2->getWidth());
 	CHECK_GL_ERRORS();
 
 	vertical_blur_program->use();
 	glUniform1i(vertical_blur_program->getUniform("my_texture"), 1);
+	CHECK_GL_ERRORS();
+
+	bilateral_splat_program->use();
+	glUniform1i(bilateral_splat_program->getUniform("my_texture"), 0);
+	bilateral_blur_program->use();
+	glUniform1i(bilateral_blur_program->getUniform("grid"), 0);
+	bilateral_slice_program->use();
+	glUniform1i(bilateral_slice_program->getUniform("my_texture"), 0);
+	glUniform1i(bilateral_slice_program->getUniform("grid"), 1);
+	CHECK_GL_ERRORS();
+
+	tonemap_program->use();
+	glUniform1i(tonemap_program->getUniform("my_texture"), 0);
+	glUniform1i(tonemap_program->getUniform("average_luminance"), 1);
+	glUniform1f(tonemap_program->getUniform("key"), exposure_key);
+	if (compute_supported) {
+		luminance_histogram_program->use();
+		glUniform1i(luminance_histogram_program->getUniform("my_texture"), 0);
+		glUniform1f(luminance_histogram_program->getUniform("min_log_luminance"), min_log_luminance);
+		glUniform1f(luminance_histogram_program->getUniform("log_luminance_range"), log_luminance_range);
+		luminance_average_program->use();
+		glUniform1f(luminance_average_program->getUniform("min_log_luminance"), min_log_luminance);
+		glUniform1f(luminance_average_program->getUniform("log_luminance_range"), log_luminance_range);
+	}
+	CHECK_GL_ERRORS();
+
+	temporal_blur_program->use();
+	glUniform1i(temporal_blur_program->getUniform("my_texture"), 0);
+	glUniform1i(temporal_blur_program->getUniform("history"), 1);
+	glUniform1i(temporal_blur_program->getUniform("depth"), 2);
+	glUniform1i(temporal_blur_program->getUniform("refresh_period"), temporal_refresh_period);
+	glUniform1f(temporal_blur_program->getUniform("depth_tolerance"), temporal_depth_tolerance);
+	temporal_upsample_program->use();
+	glUniform1i(temporal_upsample_program->getUniform("my_texture"), 0);
+	CHECK_GL_ERRORS();
+
+	deferred_lighting_program->use();
+	glUniform1i(deferred_lighting_program->getUniform("normals"), 0);
+	glUniform1i(deferred_lighting_program->getUniform("materials"), 1);
+	glUniform1i(deferred_lighting_program->getUniform("depth"), 2);
+	glUniform1i(deferred_lighting_program->getUniform("lights"), 3);
+	glUniform1i(deferred_lighting_program->getUniform("clusters"), 4);
+	glUniform1i(deferred_lighting_program->getUniform("light_indices"), 5);
+	glUniform3ui(deferred_lighting_program->getUniform("cluster_counts"),
+			LightClusters::tiles_x, LightClusters::tiles_y, LightClusters::slices);
+	glUniform1f(deferred_lighting_program->getUniform("z_near"), z_near);
+	glUniform1f(deferred_lighting_program->getUniform("z_far"), z_far);
+	CHECK_GL_ERRORS();
+
+	dof_prepare_program->use();
+	glUniform1i(dof_prepare_program->getUniform("my_texture"), 0);
+	glUniform1i(dof_prepare_program->getUniform("depth"), 2);
+	glUniform1f(dof_prepare_program->getUniform("z_near"), z_near);
+	glUniform1f(dof_prepare_program->getUniform("z_far"), z_far);
+	glUniform1f(dof_prepare_program->getUniform("aperture"), dof_aperture);
+	dof_gather_program->use();
+	glUniform1i(dof_gather_program->getUniform("my_texture"), 0);
+	dof_composite_program->use();
+	glUniform1i(dof_composite_program->getUniform("my_texture"), 0);
+	glUniform1i(dof_composite_program->getUniform("blurred"), 1);
+	glUniform1i(dof_composite_program->getUniform("depth"), 2);
+	glUniform1f(dof_composite_program->getUniform("z_near"), z_near);
+	glUniform1f(dof_composite_program->getUniform("z_far"), z_far);
+	glUniform1f(dof_composite_program->getUniform("aperture"), dof_aperture);
+	glUniform1f(dof_composite_program->getUniform("max_coc"), dof_max_coc);
+	CHECK_GL_ERRORS();
+
+	bloom_bright_program->use();
+	glUniform1i(bloom_bright_program->getUniform("my_texture"), 0);
+	glUniform1i(bloom_bright_program->getUniform("depth"), 2);
+	glUniform1f(bloom_bright_program->getUniform("threshold"), bloom_threshold);
+	bloom_downsample_program->use();
+	glUniform1i(bloom_downsample_program->getUniform("my_texture"), 0);
+	bloom_upsample_program->use();
+	glUniform1i(bloom_upsample_program->getUniform("my_texture"), 0);
+	bloom_composite_program->use();
+	glUniform1i(bloom_composite_program->getUniform("my_texture"), 0);
+	glUniform1i(bloom_composite_program->getUniform("bloom"), 1);
+	glUniform1f(bloom_composite_program->getUniform("intensity"), bloom_intensity);
+	CHECK_GL_ERRORS();
+
+	fxaa_program->use();
+	glUniform1i(fxaa_program->getUniform("my_texture"), 0);
+	CHECK_GL_ERRORS();
+
+	const float sat_scale = static_cast<float>(1u << SummedAreaTable::fraction_bits);
+	if (compute_supported) {
+		sat_scan_program->use();
+		glUniform1f(sat_scan_program->getUniform("scale"), sat_scale);
+		glUniform1f(sat_scan_program->getUniform("max_value"), static_cast<float>(SummedAreaTable::max_value));
+	}
+	sat_blur_program->use();
+	glUniform1i(sat_blur_program->getUniform("table"), 0);
+	glUniform1i(sat_blur_program->getUniform("depth"), 2);
+	glUniform1f(sat_blur_program->getUniform("z_near"), z_near);
+	glUniform1f(sat_blur_program->getUniform("z_far"), z_far);
+	glUniform1f(sat_blur_program->getUniform("aperture"), dof_aperture);
+	glUniform1f(sat_blur_program->getUniform("max_radius"), variable_blur_max_radius);
+	glUniform1f(sat_blur_program->getUniform("scale"), sat_scale);
+	CHECK_GL_ERRORS();
+
+	setSizeDependentUniforms();
+}
+
+void GameManager::setSizeDependentUniforms() {
+	projection_matrix = glm::perspective(45.0f,
+			window_width / (float) window_height, z_near, z_far);
+
+	phong_program->use();
+	glUniformMatrix4fv(phong_program->getUniform("projection_matrix"), 1, 0, glm::value_ptr(projection_matrix));
+	CHECK_GL_ERRORS();
+
+	gbuffer_program->use();
+	glUniformMatrix4fv(gbuffer_program->getUniform("projection_matrix"), 1, 0, glm::value_ptr(projection_matrix));
+	deferred_lighting_program->use();
+	glUniformMatrix4fv(deferred_lighting_program->getUniform("inverse_projection"), 1, 0, glm::value_ptr(glm::inverse(projection_matrix)));
+	glUniform2f(deferred_lighting_program->getUniform("tile_size"),
+			fbo1->getWidth() / static_cast<float>(LightClusters::tiles_x), fbo1->getHeight() / static_cast<float>(LightClusters::tiles_y));
+	light_clusters.setProjection(projection_matrix, z_near, z_far);
+	CHECK_GL_ERRORS();
+
+	horizontal_blur_program->use();
+	glUniform1f(horizontal_blur_program->getUniform("dx"), 1.0f / fbo2->getWidth());
+
+	vertical_blur_program->use();
 	glUniform1f(vertical_blur_program->getUniform("dy"), 1.0f / fbo2->getHeight());
 	CHECK_GL_ERRORS();
+
+	temporal_blur_program->use();
+	glUniform1f(temporal_blur_program->getUniform("dx"), 1.0f / fbo2->getWidth());
+	glUniformMatrix4fv(temporal_blur_program->getUniform("inverse_projection"), 1, 0, glm::value_ptr(glm::inverse(projection_matrix)));
+	CHECK_GL_ERRORS();
+
+	fxaa_program->use();
+	glUniform2f(fxaa_program->getUniform("texel"), 1.0f / fbo1->getWidth(), 1.0f / fbo1->getHeight());
+	CHECK_GL_ERRORS();
+
+	//The circle of confusion is in scene pixels, the gather works in texels of dof_fbos
+	dof_gather_program->use();
+	glUniform2f(dof_gather_program->getUniform("texel"), 1.0f / dof_fbos[0]->getWidth(), 1.0f / dof_fbos[0]->getHeight());
+	glUniform1f(dof_gather_program->getUniform("max_radius"), dof_max_coc * dof_fbos[0]->getWidth() / fbo1->getWidth());
+	CHECK_GL_ERRORS();
+
+	//One bilateral grid cell covers as many pixels as one texel of the downscaled blur
+	const float sigma_s = static_cast<float>(1u << downscale_level);
+
+	bilateral_splat_program->use();
+	glUniform1i(bilateral_splat_program->getUniform("width"), fbo1->getWidth());
+	glUniform3fv(bilateral_splat_program->getUniform("grid_size"), 1, glm::value_ptr(grid_size));
+	glUniform1f(bilateral_splat_program->getUniform("sigma_s"), sigma_s);
+	glUniform1f(bilateral_splat_program->getUniform("sigma_r"), range_sigma);
+	glUniform1f(bilateral_splat_program->getUniform("padding"), static_cast<float>(grid_padding));
+
+	bilateral_slice_program->use();
+	glUniform2f(bilateral_slice_program->getUniform("scene_size"), static_cast<float>(fbo1->getWidth()), static_cast<float>(fbo1->getHeight()));
+	glUniform3fv(bilateral_slice_program->getUniform("grid_size"), 1, glm::value_ptr(grid_size));
+	glUniform1f(bilateral_slice_program->getUniform("sigma_s"), sigma_s);
+	glUniform1f(bilateral_slice_program->getUniform("sigma_r"), range_sigma);
+	glUniform1f(bilateral_slice_program->getUniform("padding"), static_cast<float>(grid_padding));
+	Program::disuse();
+	CHECK_GL_ERRORS();
 }
 
 void GameManager::createVAO() {
+	TRACE_SCOPE("createVAO");
+	ResourceScope scope("createVAO");
 	glGenVertexArrays(max_vaos, vaos);
+	for (unsigned int i=0; i<max_vaos; ++i)
+		ResourceRegistry::add(RESOURCE_VERTEX_ARRAY, vaos[i], 0);
 
 	//Load a model into vao 0
 	glBindVertexArray(vaos[0]);
@@ -158,6 +521,16 @@ void GameManager::createVAO() {
 	indices->bind();
 	CHECK_GL_ERRORS();
 
+	//vao 2 is left without attributes, for vertices generated from gl_VertexID
+
+	//The model again in vao 3, as the G-buffer program may place its attributes elsewhere
+	glBindVertexArray(vaos[3]);
+	model->getVertices()->bind();
+	gbuffer_program->setAttributePointer("position", 3);
+	model->getNormals()->bind();
+	gbuffer_program->setAttributePointer("normal", 3);
+	CHECK_GL_ERRORS();
+
 	//Unbind and check for errors
 	vertices->unbind(); //Unbinds both vertices and normals
 	glBindVertexArray(0);
@@ -165,16 +538,118 @@ void GameManager::createVAO() {
 }
 
 void GameManager::createFBO() {
-	
-	//Create two FBO for multipass rendering
-	fbo1.reset(new TextureFBO(window_width, window_height));
-	fbo1->unbind();
+	TRACE_SCOPE("createFBO");
+	ResourceScope scope("createFBO");
+	unsigned int scene_width = std::max(1u, static_cast<unsigned int>(window_width*render_scale));
+	unsigned int scene_height = std::max(1u, static_cast<unsigned int>(window_height*render_scale));
+
+	//Render at a lower resolution rather than fail on huge outputs
+	if (scene_width > max_target_size || scene_height > max_target_size) {
+		float fit = max_target_size / static_cast<float>(std::max(scene_width, scene_height));
+		scene_width = std::max(1u, static_cast<unsigned int>(scene_width*fit));
+		scene_height = std::max(1u, static_cast<unsigned int>(scene_height*fit));
+		cerr << "Output too large, rendering at " << scene_width << "x" << scene_height << endl;
+	}
+
+	//Give the old targets back to the pool first, so they can be reused
+	fbo1.reset();
+	msaa_fbo.reset();
+	fxaa_fbo.reset();
+	fbo2.reset();
+	greyscale_fbo.reset();
+	blur_fbo.reset();
+	for (unsigned int i=0; i<2; ++i)
+		history_fbos[i].reset();
+	for (unsigned int i=0; i<2; ++i)
+		dof_fbos[i].reset();
+	for (unsigned int i=0; i<bloom_levels; ++i)
+		bloom_fbos[i].reset();
+
+	//Create the FBOs for multipass rendering: the scene, the downscaled
+	//blur target, and one output target for each filter
+	fbo1 = target_pool.acquire(scene_width, scene_height);
+	fbo2 = target_pool.acquire(std::max(1u, scene_width >> downscale_level), std::max(1u, scene_height >> downscale_level));
+	greyscale_fbo = target_pool.acquire(scene_width, scene_height);
+	blur_fbo = target_pool.acquire(scene_width, scene_height);
+	for (unsigned int i=0; i<2; ++i)
+		history_fbos[i] = target_pool.acquire(fbo2->getWidth(), fbo2->getHeight());
+	for (unsigned int i=0; i<2; ++i)
+		dof_fbos[i] = target_pool.acquire(std::max(1u, scene_width >> dof_downscale_level), std::max(1u, scene_height >> dof_downscale_level));
+	for (unsigned int i=0; i<bloom_levels; ++i)
+		bloom_fbos[i] = target_pool.acquire(std::max(1u, scene_width >> (i+1)), std::max(1u, scene_height >> (i+1)));
+
+	//The G-buffer is only allocated once deferred shading renders
+	if (gbuffer && (gbuffer->getWidth() != scene_width || gbuffer->getHeight() != scene_height))
+		gbuffer.reset();
+
+	//The summed-area table is only allocated once the variable blur runs
+	if (summed_area_table && (summed_area_table->getWidth() != scene_width || summed_area_table->getHeight() != scene_height))
+		summed_area_table.reset();
+
+	//The antialiasing targets only exist while in use
+	if (antialiasing == ANTIALIAS_MSAA)
+		msaa_fbo = target_pool.acquire(scene_width, scene_height, msaa_samples);
+	else if (antialiasing == ANTIALIAS_FXAA)
+		fxaa_fbo = target_pool.acquire(scene_width, scene_height);
+
+	//Keep the whole set of targets of the two previous sizes, so dynamic
+	//resolution can step back and forth without reallocating any of them
+	target_pool.setMaxFree(2*target_pool.getInUse());
+
+	//The bilateral grid has a cell per 2^downscale_level pixels, and a layer
+	//per range_sigma of luminance, plus padding for the grid blur
+	const unsigned int cell_size = 1u << downscale_level;
+	const unsigned int grid_width = (scene_width - 1 + cell_size/2) / cell_size + 1 + 2*grid_padding;
+	const unsigned int grid_height = (scene_height - 1 + cell_size/2) / cell_size + 1 + 2*grid_padding;
+	const unsigned int grid_depth = static_cast<unsigned int>(1.0f / range_sigma + 0.5f) + 1 + 2*grid_padding;
+	grid_size = glm::vec3(grid_width, grid_height, grid_depth);
+
+	//The grids themselves are only allocated once the bilateral filter runs
+	if (grid_fbos[0] && (grid_fbos[0]->getWidth() != grid_width || grid_fbos[0]->getHeight() != grid_height
+			|| grid_fbos[0]->getDepth() != grid_depth)) {
+		for (unsigned int i=0; i<2; ++i)
+			grid_fbos[i].reset();
+	}
+
+	//The cached contents of the old targets are gone
+	scene_stage.invalidate();
+	fxaa_stage.invalidate();
+	greyscale_stage.invalidate();
+	vertical_blur_stage.invalidate();
+	horizontal_blur_stage.invalidate();
+	wide_blur_stage.invalidate();
+	bilateral_stage.invalidate();
+	temporal_blur_stage.invalidate();
+	split_stage.invalidate();
+	dof_stage.invalidate();
+	bloom_stage.invalidate();
+	variable_blur_stage.invalidate();
+	history_valid = false;
+}
+
+void GameManager::createExposure() {
+	TRACE_SCOPE("createExposure");
+	ResourceScope scope("createExposure");
+	exposure_fbo.reset(new TextureFBO(1, 1));
 
-	fbo2.reset(new TextureFBO(window_width >> downscale_level, window_height >> downscale_level));
-	fbo2->unbind();
+	//Zero means no luminance metered yet. Without compute shaders, store
+	//the key instead, which gives a fixed exposure of one.
+	exposure_fbo->bind();
+	if (compute_supported) glClearColor(0.0, 0.0, 0.0, 0.0);
+	else glClearColor(exposure_key, 0.0, 0.0, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor( .0,  .0, 1.0, 1.0);
+	exposure_fbo->unbind();
+
+	if (compute_supported) {
+		std::vector<GLuint> zeros(histogram_bins, 0);
+		histogram_buffer.reset(new BO<GL_SHADER_STORAGE_BUFFER>(&zeros[0], histogram_bins*sizeof(GLuint), GL_DYNAMIC_COPY));
+	}
+	CHECK_GL_ERRORS();
 }
 
-void GameManager::init() {
+void GameManager::init(bool hidden) {
+	TRACE_SCOPE("init");
 	// Initialize SDL
 	if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
 		std::stringstream err;
@@ -183,214 +658,1655 @@ void GameManager::init() {
 	}
 	atexit(SDL_Quit);
 
-	createOpenGLContext();
+	createOpenGLContext(hidden);
 	setOpenGLStates();
 	createFBO();
 	createMatrices();
 	createSimpleProgram();
 	createVAO();
+	createExposure();
+	createLights();
+}
+
+void GameManager::createLights() {
+	TRACE_SCOPE("createLights");
+	ResourceScope scope("createLights");
+
+	//A fixed seed, so every run, and every replay, has the same lights
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	light_spheres.resize(max_lights);
+	light_colors.resize(max_lights);
+	for (unsigned int i=0; i<max_lights; ++i) {
+		//In a shell around the model, which fills [-1.5, 1.5]
+		const float z = 2.0f*uniform(random) - 1.0f;
+		const float phi = 6.2831853f*uniform(random);
+		const float r = std::sqrt(1.0f - z*z);
+		const float distance = 1.0f + 1.0f*uniform(random);
+		const float radius = 0.4f + 0.4f*uniform(random);
+		light_spheres[i] = glm::vec4(distance*r*std::cos(phi), distance*r*std::sin(phi), distance*z, radius);
+		light_colors[i] = glm::vec4(uniform(random), uniform(random), uniform(random), 0.0f) * 0.5f;
+	}
+	view_lights.resize(max_lights);
+	light_data.resize(2*max_lights);
+
+	//The buffers are filled by renderDeferred
+	light_buffer.reset(new BO<GL_TEXTURE_BUFFER>(NULL, 2*max_lights*sizeof(glm::vec4), GL_STREAM_DRAW));
+	cluster_buffer.reset(new BO<GL_TEXTURE_BUFFER>(NULL, 2*LightClusters::cluster_count*sizeof(GLuint), GL_STREAM_DRAW));
+	light_index_buffer.reset(new BO<GL_TEXTURE_BUFFER>(NULL, sizeof(GLuint), GL_STREAM_DRAW));
+
+	const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+	const GLuint buffers[3] = { light_buffer->name(), cluster_buffer->name(), light_index_buffer->name() };
+	glGenTextures(3, light_textures);
+	for (unsigned int i=0; i<3; ++i) {
+		glBindTexture(GL_TEXTURE_BUFFER, light_textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+		ResourceRegistry::add(RESOURCE_TEXTURE, light_textures[i], 0); //The memory is counted with the buffer
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	CHECK_GL_ERRORS();
+}
+
+void GameManager::setResolution(unsigned int width, unsigned int height) {
+	window_width = width;
+	window_height = height;
+	if (!main_window) return; //Applied when the context is created
+
+	SDL_SetWindowSize(main_window, window_width, window_height);
+	resizeTargets();
 }
 
-void GameManager::renderMeshRecursive(MeshPart& mesh, const std::shared_ptr<Program>& program, 
+void GameManager::resizeTargets() {
+	resize_pending = false;
+	trackball.setWindowSize(window_width, window_height);
+	capture.reset(); //The capture size is fixed, so stop it
+	capture_fbo.reset();
+
+	//Reallocate the targets, and update the projection and texel
+	//sizes in the same go, so they always agree
+	createFBO();
+	target_pool.clear(); //Targets of the old size are not coming back
+	setSizeDependentUniforms();
+	scheduler.requestRedraw();
+}
+
+void GameManager::setDownscaleLevel(unsigned int level) {
+	downscale_level = level;
+	if (!main_window) return;
+
+	createFBO();
+	setSizeDependentUniforms();
+}
+
+void GameManager::setDepthOfFieldLevel(unsigned int level) {
+	dof_downscale_level = level;
+	std::cout << "Depth of field gathered at 1/" << (1u << level) << " resolution" << std::endl;
+	if (!main_window) return;
+
+	createFBO();
+	setSizeDependentUniforms();
+	scheduler.requestRedraw();
+}
+
+void GameManager::setAntialiasing(Antialiasing mode) {
+	if (main_window && mode == ANTIALIAS_MSAA && msaa_samples < 2) {
+		cerr << "Multisampled targets not supported" << endl;
+		return;
+	}
+	antialiasing = mode;
+	if (!main_window) return;
+
+	createFBO();
+	setSizeDependentUniforms();
+	scheduler.requestRedraw();
+
+	std::cout << "Antialiasing: " << getAntialiasingName(antialiasing);
+	if (msaa_fbo)
+		std::cout << ", " << msaa_samples << " samples in "
+			<< (msaa_fbo->getColorBytes() + msaa_fbo->getDepthBytes()) / (1024*1024) << " MB";
+	if (fxaa_fbo)
+		std::cout << ", one pass into " << fxaa_fbo->getColorBytes() / (1024*1024) << " MB";
+	if (deferred_shading && antialiasing == ANTIALIAS_MSAA)
+		std::cout << " (forward shading only)";
+	std::cout << std::endl;
+}
+
+const char* GameManager::getAntialiasingName(Antialiasing mode) {
+	switch (mode) {
+	case ANTIALIAS_NONE: return "none";
+	case ANTIALIAS_MSAA: return "msaa";
+	case ANTIALIAS_FXAA: return "fxaa";
+	default: return "unknown";
+	}
+}
+
+void GameManager::setComputeBlur(bool enable) {
+	if (main_window && enable && !compute_supported) {
+		cerr << "OpenGL 4.3 not available, blurring in fragment shaders" << endl;
+		return;
+	}
+	compute_blur = enable;
+	if (!main_window) return;
+
+	scheduler.requestRedraw();
+	std::cout << "Downscaled blur in " << (compute_blur ? "compute" : "fragment") << " shaders" << std::endl;
+}
+
+void GameManager::setRenderScale(float scale, unsigned int level) {
+	if (scale == render_scale && level == downscale_level) return;
+	render_scale = scale;
+	downscale_level = level;
+
+	createFBO();
+	setSizeDependentUniforms();
+	scheduler.requestRedraw();
+}
+
+void GameManager::toggleAllocationTracking() {
+	if (track_allocations) {
+		track_allocations = false;
+		AllocationTracker::report(std::cout, tracked_frames);
+		return;
+	}
+
+	AllocationTracker::reset();
+	tracked_frames = 0;
+	track_allocations = true;
+	std::cout << "Counting heap allocations in render()" << std::endl;
+}
+
+void GameManager::setInputRecording(const std::string& filename) {
+	recording.reset(new InputTrace());
+	recording_filename = filename;
+}
+
+void GameManager::setInputReplay(const std::string& filename) {
+	replay.reset(new InputTrace());
+	replay->load(filename);
+
+	//Start from the state the recording started from
+	const InputTrace::State& state = replay->getInitialState();
+	setResolution(state.width, state.height);
+	setDownscaleLevel(state.downscale_level);
+	filterMode = static_cast<RenderMode>(state.render_mode);
+}
+
+void GameManager::toggleDynamicResolution() {
+	if (resolution_controller) {
+		//Back to full quality
+		resolution_controller->reset();
+		setRenderScale(1.0f, resolution_controller->getDownscaleLevel());
+		resolution_controller.reset();
+		std::cout << "Dynamic resolution off" << std::endl;
+		return;
+	}
+
+	resolution_controller.reset(new ResolutionController(16.6, downscale_level));
+	if (!profiler) profiler.reset(new PassProfiler());
+	std::cout << "Dynamic resolution on, budget " << resolution_controller->getBudget() << " ms" << std::endl;
+}
+
+void GameManager::setFilterMode(RenderMode mode) {
+	filterMode = mode;
+	scheduler.requestRedraw();
+}
+
+const char* GameManager::getRenderModeName(RenderMode mode) {
+	switch (mode) {
+	case RenderMode::STANDARD: return "standard";
+	case RenderMode::BLUR: return "blur";
+	case RenderMode::GREYSCALE: return "greyscale";
+	case RenderMode::COMBO: return "combo";
+	case RenderMode::RECURSIVE_BLUR: return "recursive_blur";
+	case RenderMode::BOX_BLUR: return "box_blur";
+	case RenderMode::BILATERAL: return "bilateral";
+	case RenderMode::TONEMAP: return "tonemap";
+	case RenderMode::TEMPORAL_BLUR: return "temporal_blur";
+	case RenderMode::SPLIT_VIEW: return "split_view";
+	case RenderMode::DEPTH_OF_FIELD: return "depth_of_field";
+	case RenderMode::BLOOM: return "bloom";
+	case RenderMode::VARIABLE_BLUR: return "variable_blur";
+	default: return "unknown";
+	}
+}
+
+void GameManager::setViewRotation(const glm::mat4& rotation) {
+	trackball_view_matrix = rotation;
+	scheduler.requestRedraw();
+}
+
+void GameManager::renderMeshRecursive(const MeshPart& mesh, GLint modelview_location, GLint modelview_inverse_location,
 		const glm::mat4& view_matrix, const glm::mat4& model_matrix) {
 	//Create modelview matrix
 	glm::mat4 meshpart_model_matrix = model_matrix*mesh.transform;
 	glm::mat4 modelview_matrix = view_matrix*meshpart_model_matrix;
-	glUniformMatrix4fv(program->getUniform("modelview_matrix"), 1, 0, glm::value_ptr(modelview_matrix));
+	glUniformMatrix4fv(modelview_location, 1, 0, glm::value_ptr(modelview_matrix));
 	
 	glm::mat4 modelview_inverse_matrix = glm::inverse(glm::mat4(modelview_matrix));
-	glUniformMatrix4fv(program->getUniform("modelview_inverse_matrix"), 1, 0, glm::value_ptr(modelview_inverse_matrix));
+	glUniformMatrix4fv(modelview_inverse_location, 1, 0, glm::value_ptr(modelview_inverse_matrix));
 	
 	if (mesh.count > 0)
 		glDrawArrays(GL_TRIANGLES, mesh.first, mesh.count);
 	for (unsigned int i=0; i<mesh.children.size(); ++i)
-		renderMeshRecursive(mesh.children.at(i), program, view_matrix, meshpart_model_matrix);
+		renderMeshRecursive(mesh.children[i], modelview_location, modelview_inverse_location, view_matrix, meshpart_model_matrix);
 }
 
-void GameManager::render() {
-	//Clear screen, and set the correct program
-	glm::mat4 view_matrix_new = view_matrix*trackball_view_matrix;
+void GameManager::renderFullscreenPass(Program& program, TextureFBO& source, GLenum texture_unit, TextureFBO& target) {
+	//A smaller target samples a mipmap, or skips texels, so it reads at most its own size
+	addTraffic(std::min(source.getColorBytes(), target.getColorBytes()), target.getColorBytes());
 
-	//Set up rendering to first vbo
-	fbo1->bind();
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glViewport(0, 0, window_width, window_height);
+	target.bind();
+	glDepthMask(GL_FALSE);
+	glActiveTexture(texture_unit);
+	glBindTexture(GL_TEXTURE_2D, source.getTexture());
+	glViewport(0, 0, target.getWidth(), target.getHeight());
+	program.use();
+	glBindVertexArray(vaos[1]);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
+	glDepthMask(GL_TRUE);
+	target.unbind();
+}
 
-	//Render model to the FBO
-	phong_program->use();
-	glBindVertexArray(vaos[0]);
-	renderMeshRecursive(model->getMesh(), phong_program, view_matrix_new, model_matrix);
+void GameManager::renderRecursiveBlur(TextureFBO& source, TextureFBO& target, float sigma) {
+	//Computing the coefficients allocates, so only do it when sigma changes
+	if (sigma != recursive_sigma) {
+		recursive_coefficients = RecursiveBlur::computeCoefficients(sigma);
+		recursive_sigma = sigma;
+	}
+	const RecursiveBlur::Coefficients& c = recursive_coefficients;
+	const GLsizei width = target.getWidth();
+	const GLsizei height = target.getHeight();
+
+	//The filter runs in place, so start from a copy of the source. The
+	//copy and both directions each read and write the whole image.
+	addTraffic(3*target.getColorBytes(), 3*target.getColorBytes());
+	glCopyImageSubData(source.getTexture(), GL_TEXTURE_2D, 0, 0, 0, 0,
+			target.getTexture(), GL_TEXTURE_2D, 0, 0, 0, 0, width, height, 1);
 
-	//Unbind the FBO, and check for errors
-	fbo1->unbind();
+	recursive_blur_program->use();
+	glUniform4f(recursive_blur_program->getUniform("coefficients"), c.B, c.b1, c.b2, c.b3);
+	glUniformMatrix3fv(recursive_blur_program->getUniform("boundary"), 1, GL_TRUE, &c.M[0][0]);
+	glBindImageTexture(0, target.getTexture(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+	//One invocation per row, then one per column
+	glUniform1i(recursive_blur_program->getUniform("horizontal"), 1);
+	glDispatchCompute((height + 63) / 64, 1, 1);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	glUniform1i(recursive_blur_program->getUniform("horizontal"), 0);
+	glDispatchCompute((width + 63) / 64, 1, 1);
+
+	//The result is sampled when presenting, and read back when capturing
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+	Program::disuse();
 	CHECK_GL_ERRORS();
+}
 
-	//Switch for the different filters 
-	switch (filterMode){
+void GameManager::renderBoxBlur(TextureFBO& source, TextureFBO& target, float sigma) {
+	static const unsigned int passes = 3;
+	unsigned int sizes[passes];
+	RecursiveBlur::computeBoxSizes(sigma, passes, sizes);
+	const GLsizei width = target.getWidth();
+	const GLsizei height = target.getHeight();
 
-	//Renders Greyscale and blur if its combo mode
-	case RenderMode::COMBO:
-	case RenderMode::GREYSCALE: {
+	//Each box pass filters the rows into a scratch target, and the columns back
+	ResourceScope scope("renderBoxBlur");
+	std::shared_ptr<TextureFBO> scratch = target_pool.acquire(width, height);
+	GLuint input = source.getTexture();
+	addTraffic(2*passes*target.getColorBytes(), 2*passes*target.getColorBytes());
 
-		//Render greyscale filter to fbo1
-		fbo1->bind();
-		glDepthMask(GL_FALSE);
+	box_blur_program->use();
+	for (unsigned int i=0; i<passes; ++i) {
+		glUniform1i(box_blur_program->getUniform("radius"), sizes[i] / 2);
+
+		glUniform1i(box_blur_program->getUniform("horizontal"), 1);
+		glBindImageTexture(0, input, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+		glBindImageTexture(1, scratch->getTexture(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		glDispatchCompute((height + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		glUniform1i(box_blur_program->getUniform("horizontal"), 0);
+		glBindImageTexture(0, scratch->getTexture(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+		glBindImageTexture(1, target.getTexture(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		glDispatchCompute((width + 63) / 64, 1, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		input = target.getTexture();
+	}
+
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+	glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	Program::disuse();
+	CHECK_GL_ERRORS();
+}
+
+void GameManager::renderSeparableBlur(TextureFBO& source, unsigned int level, TextureFBO& target, bool horizontal) {
+	const unsigned int length = horizontal ? target.getWidth() : target.getHeight();
+	const unsigned int lines = horizontal ? target.getHeight() : target.getWidth();
+	const unsigned int tiles = (length + separable_blur_tile - 1) / separable_blur_tile;
+
+	//Each texel is loaded once, plus the aprons on both sides of every tile
+	addTraffic(target.getColorBytes() + static_cast<uint64_t>(2*5*tiles)*lines*4*sizeof(float), target.getColorBytes());
+
+	separable_blur_program->use();
+	glUniform1i(separable_blur_program->getUniform("horizontal"), horizontal ? 1 : 0);
+	glBindImageTexture(0, source.getTexture(), level, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+	glBindImageTexture(1, target.getTexture(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glDispatchCompute(tiles, lines, 1);
+
+	//The result is read as an image by the other direction, or sampled
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+	glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	Program::disuse();
+	CHECK_GL_ERRORS();
+}
+
+void GameManager::renderVariableBlur(TextureFBO& source, TextureFBO& target) {
+	if (!summed_area_table) {
+		ResourceScope scope("renderVariableBlur");
+		summed_area_table.reset(new SummedAreaTable(source.getWidth(), source.getHeight()));
+	}
+	SummedAreaTable& table = *summed_area_table;
+	const GLuint width = table.getWidth();
+	const GLuint height = table.getHeight();
+
+	{
+		//One workgroup per row, then per column, the columns scanned in place
+		ProfileScope scope(profiler.get(), "summed_area_table");
+		addTraffic(source.getColorBytes() + table.getBytes(), 2*table.getBytes());
+		sat_scan_program->use();
+		glBindImageTexture(0, source.getTexture(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+		glBindImageTexture(1, table.getTexture(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32UI);
+		glUniform1i(sat_scan_program->getUniform("horizontal"), 1);
+		glDispatchCompute(height, 1, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		glUniform1i(sat_scan_program->getUniform("horizontal"), 0);
+		glDispatchCompute(width, 1, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+		glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32UI);
+	}
+
+	{
+		//Four table and one depth fetch a pixel, whatever the radius
+		ProfileScope scope(profiler.get(), "variable_blur");
+		addTraffic(4*table.getBytes() + fbo1->getDepthBytes(), target.getColorBytes());
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, fbo1->getDepthTexture());
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, fbo1->getTexture());
-		glViewport(0, 0, fbo1->getWidth(), fbo1->getHeight());
-		greyscale_program->use();
+		glBindTexture(GL_TEXTURE_2D, table.getTexture());
+		target.bind();
+		glDepthMask(GL_FALSE);
+		glViewport(0, 0, target.getWidth(), target.getHeight());
+		sat_blur_program->use();
 		glBindVertexArray(vaos[1]);
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
 		glDepthMask(GL_TRUE);
-		fbo1->unbind();
+		target.unbind();
+	}
+
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	Program::disuse();
+	CHECK_GL_ERRORS();
+}
+
+void GameManager::renderBilateralGrid(TextureFBO& source, TextureFBO& target) {
+	if (!grid_fbos[0]) {
+		ResourceScope scope("renderBilateralGrid");
+		for (unsigned int i=0; i<2; ++i)
+			grid_fbos[i].reset(new TextureFBO3D(static_cast<unsigned int>(grid_size.x),
+					static_cast<unsigned int>(grid_size.y), static_cast<unsigned int>(grid_size.z)));
+	}
+	TextureFBO3D& grid = *grid_fbos[0];
+	glDepthMask(GL_FALSE);
+	glViewport(0, 0, grid.getWidth(), grid.getHeight());
+
+	//Splat: add every pixel's colour, and a count, to its grid cell.
+	//The points are generated from gl_VertexID, so no attributes are needed.
+	grid.bind();
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor( .0,  .0, 1.0, 1.0);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	bilateral_splat_program->use();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source.getTexture());
+	glBindVertexArray(vaos[2]);
+	glDrawArrays(GL_POINTS, 0, source.getWidth()*source.getHeight());
+	glDisable(GL_BLEND);
+	addTraffic(source.getColorBytes() + grid.getBytes(), 2*grid.getBytes()); //Clear, and blending
+
+	//Blur the grid along x, y and luminance, ping-ponging between the two grids.
+	//The cost depends on the grid size, not on how many pixels a cell covers.
+	bilateral_blur_program->use();
+	glBindVertexArray(vaos[1]);
+	for (unsigned int axis=0; axis<3; ++axis) {
+		grid_fbos[(axis+1) % 2]->bind();
+		glBindTexture(GL_TEXTURE_3D, grid_fbos[axis % 2]->getTexture());
+		glUniform3i(bilateral_blur_program->getUniform("direction"), axis == 0, axis == 1, axis == 2);
+		glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0), grid.getDepth());
+	}
+	TextureFBO3D::unbind();
+	glBindTexture(GL_TEXTURE_3D, 0);
+	glDepthMask(GL_TRUE);
+	addTraffic(3*grid.getBytes(), 3*grid.getBytes());
+
+	//Slice: sample the blurred grid at each pixel's position and luminance
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_3D, grid_fbos[1]->getTexture());
+	addTraffic(grid.getBytes(), 0);
+	renderFullscreenPass(*bilateral_slice_program, source, GL_TEXTURE0, target);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_3D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	CHECK_GL_ERRORS();
+}
+
+void GameManager::renderMetering(TextureFBO& source) {
+	//Meter at most about a million samples, which is plenty for a histogram
+	const unsigned int pixels = source.getWidth()*source.getHeight();
+	unsigned int stride = 1;
+	while (pixels / (stride*stride) > max_metered_samples) ++stride;
+	const unsigned int samples_x = (source.getWidth() + stride - 1) / stride;
+	const unsigned int samples_y = (source.getHeight() + stride - 1) / stride;
+
+	//Adapt at the same speed regardless of frame rate
+	float dt = std::min(static_cast<float>(exposure_timer.elapsedAndRestart()), 0.1f);
+	if (replay) dt = replay_timestep;
+	const float adaptation = 1.0f - std::exp(-dt / adaptation_time);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, histogram_buffer->name());
+
+	luminance_histogram_program->use();
+	glUniform1i(luminance_histogram_program->getUniform("stride"), stride);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source.getTexture());
+	glDispatchCompute((samples_x + 15) / 16, (samples_y + 15) / 16, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	addTraffic(samples_x*samples_y*4*sizeof(float), histogram_bins*sizeof(GLuint));
 
+	luminance_average_program->use();
+	glUniform1i(luminance_average_program->getUniform("sample_count"), samples_x*samples_y);
+	glUniform1f(luminance_average_program->getUniform("adaptation"), adaptation);
+	glBindImageTexture(0, exposure_fbo->getTexture(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
-	}if(filterMode == RenderMode::GREYSCALE) break; //breaks only if in grayscale mode
-	case RenderMode::BLUR: {
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+	Program::disuse();
+	CHECK_GL_ERRORS();
+}
+
+void GameManager::renderTemporalBlur(const glm::mat4& view) {
+	TextureFBO& previous = *history_fbos[history_index];
+	TextureFBO& target = *history_fbos[1 - history_index];
+
+	//Maps view space positions of this frame to where they were in the history
+	const glm::mat4 reprojection = projection_matrix*history_view_matrix*glm::inverse(view);
+
+	temporal_blur_program->use();
+	glUniformMatrix4fv(temporal_blur_program->getUniform("reprojection"), 1, 0, glm::value_ptr(reprojection));
+	glUniform1i(temporal_blur_program->getUniform("history_valid"), history_valid ? 1 : 0);
+	glUniform1i(temporal_blur_program->getUniform("refresh_phase"), temporal_frame % temporal_refresh_period);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, previous.getTexture());
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, fbo1->getDepthTexture());
+	addTraffic(previous.getColorBytes() + target.getWidth()*target.getHeight()*4, 0); //History, and one depth sample a pixel
+	renderFullscreenPass(*temporal_blur_program, *fbo2, GL_TEXTURE0, target);
+
+	//Without history, every tile was blurred afresh
+	temporal_refresh_frames = history_valid ? temporal_refresh_frames + 1 : temporal_refresh_period;
+	history_index = 1 - history_index;
+	history_valid = true;
+	history_view_matrix = view;
+	++temporal_frame;
+
+	//Upsample to the scene resolution, dropping the depth kept in alpha
+	renderFullscreenPass(*temporal_upsample_program, target, GL_TEXTURE0, *blur_fbo);
+
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	Program::disuse();
+	CHECK_GL_ERRORS();
+}
+
+void GameManager::setScissor(TextureFBO& target, unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(x, y, width, height);
+	pass_coverage = (width*height) / static_cast<float>(target.getWidth()*target.getHeight());
+}
 
-		//Generate mipmaps
+void GameManager::clearScissor() {
+	glDisable(GL_SCISSOR_TEST);
+	pass_coverage = 1.0f;
+}
+
+void GameManager::renderSplitView(TextureFBO& scene) {
+	//Standard and greyscale on the left, blur and combo on the right, with the
+	//unfiltered ones on top. Every quarter shows its own part of the image.
+	const unsigned int width = blur_fbo->getWidth();
+	const unsigned int height = blur_fbo->getHeight();
+	const unsigned int half_width = width / 2;
+	const unsigned int half_height = height / 2;
+
+	{
+		ProfileScope scope(profiler.get(), "split_standard");
+		setScissor(*blur_fbo, 0, half_height, half_width, height - half_height);
+		renderFullscreenPass(*passthrough_program, scene, GL_TEXTURE0, *blur_fbo);
+	}
+
+	{
+		ProfileScope scope(profiler.get(), "split_greyscale");
+		setScissor(*blur_fbo, 0, 0, half_width, half_height);
+		renderFullscreenPass(*greyscale_program, scene, GL_TEXTURE0, *blur_fbo);
+	}
+
+	//Blur the right half once for both blur and combo. The downscaled pass
+	//also covers the texels the horizontal kernel reaches from the left half.
+	{
+		ProfileScope scope(profiler.get(), "split_vertical_blur");
+		clearScissor();
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, fbo1->getTexture());
+		glBindTexture(GL_TEXTURE_2D, scene.getTexture());
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glGenerateMipmap(GL_TEXTURE_2D);
+		addTraffic(scene.getColorBytes(), scene.getColorBytes() / 3);
 
+		const unsigned int halo = BlurKernel::radius + 1;
+		const unsigned int left = std::max(static_cast<int>(fbo2->getWidth() / 2) - static_cast<int>(halo), 0);
+		setScissor(*fbo2, left, 0, fbo2->getWidth() - left, fbo2->getHeight());
+		renderFullscreenPass(*vertical_blur_program, scene, GL_TEXTURE1, *fbo2);
+	}
 
-		//blur vertically
-		fbo2->bind();
-		glDepthMask(GL_FALSE);
+	{
+		ProfileScope scope(profiler.get(), "split_blur");
+		setScissor(*blur_fbo, half_width, half_height, width - half_width, height - half_height);
+		renderFullscreenPass(*horizontal_blur_program, *fbo2, GL_TEXTURE0, *blur_fbo);
+	}
+
+	//Greyscale and blur are both linear, so combo (greyscale, then blur) is
+	//the greyscale of the blur. Blur into the scratch target first, as the
+	//pass cannot read and write blur_fbo at once.
+	{
+		ProfileScope scope(profiler.get(), "split_combo");
+		setScissor(*blur_fbo, half_width, 0, width - half_width, half_height);
+		renderFullscreenPass(*horizontal_blur_program, *fbo2, GL_TEXTURE0, *greyscale_fbo);
+		renderFullscreenPass(*greyscale_program, *greyscale_fbo, GL_TEXTURE0, *blur_fbo);
+	}
+
+	//Thin lines between the quarters
+	blur_fbo->bind();
+	glClearColor(1.0, 1.0, 1.0, 1.0);
+	setScissor(*blur_fbo, std::max(half_width, 1u) - 1, 0, 2, height);
+	glClear(GL_COLOR_BUFFER_BIT);
+	setScissor(*blur_fbo, 0, std::max(half_height, 1u) - 1, width, 2);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor( .0,  .0, 1.0, 1.0);
+	blur_fbo->unbind();
+
+	clearScissor();
+	Program::disuse();
+	CHECK_GL_ERRORS();
+}
+
+void GameManager::renderDepthOfField(TextureFBO& scene) {
+	TextureFBO& prepared = *dof_fbos[0];
+	TextureFBO& gathered = *dof_fbos[1];
+	const uint64_t depth_reads = static_cast<uint64_t>(prepared.getWidth())*prepared.getHeight()*4;
+
+	{
+		//Downsample the scene through its mipmaps, keeping the circle of confusion in alpha
+		ProfileScope scope(profiler.get(), "dof_prepare");
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, scene.getTexture());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		addTraffic(scene.getColorBytes(), scene.getColorBytes() / 3);
+
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, fbo1->getDepthTexture());
+		addTraffic(depth_reads, 0);
+		renderFullscreenPass(*dof_prepare_program, scene, GL_TEXTURE0, prepared);
+	}
+
+	{
+		//Every pixel reads a disk of samples, as wide as the widest circle
+		ProfileScope scope(profiler.get(), "dof_gather");
+		addTraffic(31*prepared.getColorBytes(), 0);
+		renderFullscreenPass(*dof_gather_program, prepared, GL_TEXTURE0, gathered);
+	}
+
+	{
+		ProfileScope scope(profiler.get(), "dof_composite");
 		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, fbo1->getTexture());
-		glViewport(0, 0, fbo2->getWidth(), fbo2->getHeight());
-		vertical_blur_program->use();
-		glBindVertexArray(vaos[1]);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
-		glDepthMask(GL_TRUE);
-		fbo2->unbind();
+		glBindTexture(GL_TEXTURE_2D, gathered.getTexture());
+		addTraffic(gathered.getColorBytes() + static_cast<uint64_t>(blur_fbo->getWidth())*blur_fbo->getHeight()*4, 0);
+		renderFullscreenPass(*dof_composite_program, scene, GL_TEXTURE0, *blur_fbo);
+	}
 
-		//blur horizontally
-		fbo1->bind();
-		glDepthMask(GL_FALSE);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	Program::disuse();
+	CHECK_GL_ERRORS();
+}
+
+void GameManager::renderBloom(TextureFBO& scene) {
+	{
+		//Straight from the scene to half resolution, so it is read only once
+		ProfileScope scope(profiler.get(), "bloom_bright");
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, scene.getTexture());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, fbo1->getDepthTexture());
+		bloom_bright_program->use();
+		glUniform2f(bloom_bright_program->getUniform("texel"), 1.0f / scene.getWidth(), 1.0f / scene.getHeight());
+		//The pass reads the whole scene, not its own size, and four depth samples a pixel
+		addTraffic(scene.getColorBytes() - bloom_fbos[0]->getColorBytes() + bloom_fbos[0]->getWidth()*bloom_fbos[0]->getHeight()*16, 0);
+		renderFullscreenPass(*bloom_bright_program, scene, GL_TEXTURE0, *bloom_fbos[0]);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, 0);
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, fbo2->getTexture());
+	}
+
+	{
+		ProfileScope scope(profiler.get(), "bloom_downsample");
+		bloom_downsample_program->use();
+		for (unsigned int i=1; i<bloom_levels; ++i) {
+			TextureFBO& source = *bloom_fbos[i-1];
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, source.getTexture());
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glUniform2f(bloom_downsample_program->getUniform("texel"), 1.0f / source.getWidth(), 1.0f / source.getHeight());
+			addTraffic(source.getColorBytes() - bloom_fbos[i]->getColorBytes(), 0);
+			renderFullscreenPass(*bloom_downsample_program, source, GL_TEXTURE0, *bloom_fbos[i]);
+		}
+	}
+
+	{
+		//Each level keeps its downsampled glow, and gains the wider ones below it
+		ProfileScope scope(profiler.get(), "bloom_upsample");
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		bloom_upsample_program->use();
+		for (unsigned int i=bloom_levels-1; i>0; --i) {
+			TextureFBO& source = *bloom_fbos[i];
+			TextureFBO& target = *bloom_fbos[i-1];
+			glUniform2f(bloom_upsample_program->getUniform("texel"), 1.0f / source.getWidth(), 1.0f / source.getHeight());
+			addTraffic(target.getColorBytes(), 0); //Blending reads the target
+			renderFullscreenPass(*bloom_upsample_program, source, GL_TEXTURE0, target);
+		}
+		glDisable(GL_BLEND);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	Program::disuse();
+	CHECK_GL_ERRORS();
+}
+
+void GameManager::filterImages(const std::string& input_dir, const std::string& output_dir, RenderMode mode) {
+	if (mode != RenderMode::BLUR && mode != RenderMode::GREYSCALE && mode != RenderMode::COMBO)
+		THROW_EXCEPTION("Only the blur, greyscale and combo filters can be applied to images");
+
+	BatchFilter batch(input_dir, output_dir);
+	unsigned int width, height;
+	while (batch.next(width, height)) {
+		TRACE_SCOPE("filter image");
+		//Images of the same size reuse the same three targets from the pool
+		std::shared_ptr<TextureFBO> input = target_pool.acquire(width, height);
+		std::shared_ptr<TextureFBO> scratch = target_pool.acquire(width, height);
+		std::shared_ptr<TextureFBO> result = target_pool.acquire(width, height);
+		batch.upload(*input);
+		renderImageFilter(mode, *input, *scratch, *result);
+		batch.readback(*result);
+	}
+	batch.finish();
+
+	//Back to the texel sizes of the blur targets
+	setSizeDependentUniforms();
+}
+
+void GameManager::filterLargeImage(const std::string& input_file, const std::string& output_file, RenderMode mode,
+		unsigned int tile_size) {
+	if (mode != RenderMode::BLUR && mode != RenderMode::GREYSCALE && mode != RenderMode::COMBO)
+		THROW_EXCEPTION("Only the blur, greyscale and combo filters can be applied to images");
+
+	GLint max_texture_size;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+	tile_size = std::min(tile_size, static_cast<unsigned int>(max_texture_size));
+
+	//The blur reads BlurKernel::radius texels on each side, greyscale only the texel itself
+	const unsigned int halo = (mode == RenderMode::GREYSCALE) ? 0 : BlurKernel::radius;
+	TiledFilter tiles(input_file, output_file, tile_size, halo);
+
+	//Every tile, including its halo, has the same size, so the targets are reused throughout
+	std::shared_ptr<TextureFBO> input = target_pool.acquire(tile_size, tile_size);
+	std::shared_ptr<TextureFBO> scratch = target_pool.acquire(tile_size, tile_size);
+	std::shared_ptr<TextureFBO> result = target_pool.acquire(tile_size, tile_size);
+	while (tiles.next()) {
+		TRACE_SCOPE("filter tile");
+		tiles.upload(*input);
+		renderImageFilter(mode, *input, *scratch, *result);
+		tiles.readback(*result);
+	}
+	tiles.finish();
+
+	setSizeDependentUniforms();
+}
+
+void GameManager::renderImageFilter(RenderMode mode, TextureFBO& input, TextureFBO& scratch, TextureFBO& result) {
+	//Blur at the full image resolution
+	horizontal_blur_program->use();
+	glUniform1f(horizontal_blur_program->getUniform("dx"), 1.0f / input.getWidth());
+	vertical_blur_program->use();
+	glUniform1f(vertical_blur_program->getUniform("dy"), 1.0f / input.getHeight());
+
+	TextureFBO* source = &input;
+	if (mode != RenderMode::BLUR) {
+		renderFullscreenPass(*greyscale_program, *source, GL_TEXTURE0, result);
+		source = &result;
+	}
+	if (mode != RenderMode::GREYSCALE) {
+		renderFullscreenPass(*vertical_blur_program, *source, GL_TEXTURE1, scratch);
+		renderFullscreenPass(*horizontal_blur_program, scratch, GL_TEXTURE0, result);
+	}
+	Program::disuse();
+	CHECK_GL_ERRORS();
+}
+
+void GameManager::setDeferredShading(bool enable, unsigned int lights) {
+	deferred_shading = enable;
+	light_count = std::min(lights, max_lights);
+	scheduler.requestRedraw();
+	if (!deferred_shading)
+		gbuffer.reset();
+	if (deferred_shading)
+		std::cout << "Deferred shading with " << light_count << " lights" << std::endl;
+	else
+		std::cout << "Forward shading with one light" << std::endl;
+}
+
+void GameManager::renderDeferred(const glm::mat4& view) {
+	if (!gbuffer) {
+		ResourceScope scope("renderDeferred");
+		gbuffer.reset(new TextureFBO(fbo1->getWidth(), fbo1->getHeight(), 2));
+	}
+
+	{
+		ProfileScope scope(profiler.get(), "gbuffer");
+		gbuffer->bind();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glViewport(0, 0, gbuffer->getWidth(), gbuffer->getHeight());
+		gbuffer_program->use();
+		glBindVertexArray(vaos[3]);
+		renderMeshRecursive(model->getMesh(), gbuffer_program->getUniform("modelview_matrix"),
+				gbuffer_program->getUniform("modelview_inverse_matrix"), view, model_matrix);
+		addTraffic(gbuffer->getDepthBytes(), gbuffer->getColorBytes() + gbuffer->getDepthBytes());
+		gbuffer->unbind();
+		CHECK_GL_ERRORS();
+	}
+
+	{
+		ProfileScope scope(profiler.get(), "light_culling");
+		for (unsigned int i=0; i<light_count; ++i) {
+			const glm::vec4 p = view * glm::vec4(glm::vec3(light_spheres[i]), 1.0f);
+			view_lights[i] = glm::vec4(glm::vec3(p), light_spheres[i].w);
+			light_data[2*i] = view_lights[i];
+			light_data[2*i+1] = light_colors[i];
+		}
+		light_clusters.assign(&view_lights[0], light_count);
+
+		//Orphan and refill the buffers, the buffer textures follow them. The
+		//light and cluster buffers are allocated at their largest size, and
+		//the index buffer only grows, so this does not allocate in steady state
+		const std::vector<GLuint>& clusters = light_clusters.getClusters();
+		const std::vector<GLuint>& light_indices = light_clusters.getIndices();
+		light_buffer->update(&light_data[0], 2*light_count*sizeof(glm::vec4));
+		cluster_buffer->update(&clusters[0], clusters.size()*sizeof(GLuint));
+		if (!light_indices.empty())
+			light_index_buffer->update(&light_indices[0], light_indices.size()*sizeof(GLuint));
+		CHECK_GL_ERRORS();
+	}
+
+	{
+		ProfileScope scope(profiler.get(), "lighting");
+		fbo1->bind();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glViewport(0, 0, fbo1->getWidth(), fbo1->getHeight());
-		horizontal_blur_program->use();
+
+		const GLuint textures[3] = { gbuffer->getTexture(0), gbuffer->getTexture(1), gbuffer->getDepthTexture() };
+		for (unsigned int i=0; i<3; ++i) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+		}
+		for (unsigned int i=0; i<3; ++i) {
+			glActiveTexture(GL_TEXTURE3 + i);
+			glBindTexture(GL_TEXTURE_BUFFER, light_textures[i]);
+		}
+
+		//The pass writes the G-buffer depth into fbo1, as forward shading would
+		glDepthFunc(GL_ALWAYS);
+		deferred_lighting_program->use();
 		glBindVertexArray(vaos[1]);
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
-		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LEQUAL);
+		addTraffic(gbuffer->getColorBytes() + gbuffer->getDepthBytes(), fbo1->getColorBytes() + fbo1->getDepthBytes());
+
+		for (unsigned int i=0; i<3; ++i) {
+			glActiveTexture(GL_TEXTURE3 + i);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+		}
+		glActiveTexture(GL_TEXTURE0);
 		fbo1->unbind();
+		CHECK_GL_ERRORS();
+	}
+}
 
-	}break;
+void GameManager::render() {
+	TRACE_SCOPE("render");
+	//Clear screen, and set the correct program
+	glm::mat4 view_matrix_new = view_matrix*trackball_view_matrix;
 
-	case RenderMode::STANDARD:
-	default:
-	break;
+	//Only re-render the scene if something it depends on has changed
+	Fingerprint scene_inputs;
+	scene_inputs.add(view_matrix_new).add(model_matrix).add(projection_matrix)
+		.add(phong_program->getName()).add(fbo1->getTexture())
+		.add(deferred_shading).add(deferred_shading ? light_count : 0u);
+	if (scene_stage.needsUpdate(scene_inputs.value())) {
+		if (deferred_shading) {
+			renderDeferred(view_matrix_new);
+		}
+		else {
+			ProfileScope scope(profiler.get(), "scene");
+			TextureFBO& target = msaa_fbo ? *msaa_fbo : *fbo1;
+
+			//Set up rendering to first vbo
+			target.bind();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glViewport(0, 0, target.getWidth(), target.getHeight());
+
+			//Render model to the FBO
+			phong_program->use();
+			glBindVertexArray(vaos[0]);
+			renderMeshRecursive(model->getMesh(), phong_program->getUniform("modelview_matrix"),
+					phong_program->getUniform("modelview_inverse_matrix"), view_matrix_new, model_matrix);
+			addTraffic(target.getDepthBytes(), target.getColorBytes() + target.getDepthBytes()); //Depth test, and the clear
+
+			//Unbind the FBO, and check for errors
+			target.unbind();
+			CHECK_GL_ERRORS();
+		}
+
+		//Deferred shading lights the single sampled G-buffer, so only FXAA applies to it
+		if (msaa_fbo && !deferred_shading) {
+			ProfileScope scope(profiler.get(), "msaa_resolve");
+			addTraffic(msaa_fbo->getColorBytes() + msaa_fbo->getDepthBytes(), fbo1->getColorBytes() + fbo1->getDepthBytes());
+			msaa_fbo->resolve(*fbo1);
+		}
+	}
+
+	//The filters read from the output of the previous stage, starting with the scene
+	TextureFBO* output = fbo1.get();
+	uint64_t output_fingerprint = scene_stage.getFingerprint();
+
+	if (fxaa_fbo) {
+		Fingerprint inputs;
+		inputs.add(output_fingerprint).add(fxaa_program->getName()).add(fxaa_fbo->getTexture());
+		if (fxaa_stage.needsUpdate(inputs.value())) {
+			ProfileScope scope(profiler.get(), "fxaa");
+			renderFullscreenPass(*fxaa_program, *output, GL_TEXTURE0, *fxaa_fbo);
+		}
+
+		output = fxaa_fbo.get();
+		output_fingerprint = fxaa_stage.getFingerprint();
+	}
+
+	//Renders greyscale if its greyscale or combo mode
+	if (filterMode == RenderMode::GREYSCALE || filterMode == RenderMode::COMBO) {
+		Fingerprint inputs;
+		inputs.add(output_fingerprint).add(greyscale_program->getName()).add(greyscale_fbo->getTexture());
+		if (greyscale_stage.needsUpdate(inputs.value())) {
+			ProfileScope scope(profiler.get(), "greyscale");
+			renderFullscreenPass(*greyscale_program, *output, GL_TEXTURE0, *greyscale_fbo);
+		}
+
+		output = greyscale_fbo.get();
+		output_fingerprint = greyscale_stage.getFingerprint();
+	}
+
+	//The constant time blurs need compute shaders, and use the downscaled blur otherwise
+	const bool wide_blur = (filterMode == RenderMode::RECURSIVE_BLUR || filterMode == RenderMode::BOX_BLUR);
+	const bool variable_blur = (filterMode == RenderMode::VARIABLE_BLUR);
+
+	//Renders blur on top of the previous stage if its blur or combo mode
+	if (filterMode == RenderMode::BLUR || filterMode == RenderMode::COMBO || filterMode == RenderMode::TEMPORAL_BLUR
+			|| ((wide_blur || variable_blur) && !compute_supported)) {
+		Fingerprint vertical_inputs;
+		vertical_inputs.add(output_fingerprint).add(vertical_blur_program->getName()).add(fbo2->getTexture()).add(compute_blur);
+		if (vertical_blur_stage.needsUpdate(vertical_inputs.value())) {
+			ProfileScope scope(profiler.get(), "vertical_blur");
+
+			//Generate mipmaps
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, output->getTexture());
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			addTraffic(output->getColorBytes(), output->getColorBytes() / 3);
+
+			//blur vertically, from the mipmap level with the size of fbo2
+			if (compute_blur) renderSeparableBlur(*output, downscale_level, *fbo2, false);
+			else renderFullscreenPass(*vertical_blur_program, *output, GL_TEXTURE1, *fbo2);
+		}
+
+		if (filterMode == RenderMode::TEMPORAL_BLUR) {
+			//Keep rendering after the scene changes until every tile is refreshed
+			Fingerprint temporal_inputs;
+			temporal_inputs.add(vertical_blur_stage.getFingerprint()).add(temporal_blur_program->getName()).add(blur_fbo->getTexture());
+			if (temporal_blur_stage.needsUpdate(temporal_inputs.value())) temporal_refresh_frames = 0;
+			if (temporal_refresh_frames < temporal_refresh_period) {
+				ProfileScope scope(profiler.get(), "temporal_blur");
+				renderTemporalBlur(view_matrix_new);
+				if (temporal_refresh_frames < temporal_refresh_period) scheduler.requestRedraw();
+				horizontal_blur_stage.invalidate();
+				wide_blur_stage.invalidate();
+				bilateral_stage.invalidate();
+				split_stage.invalidate();
+				dof_stage.invalidate();
+				variable_blur_stage.invalidate();
+			}
+		}
+		else {
+			Fingerprint horizontal_inputs;
+			horizontal_inputs.add(vertical_blur_stage.getFingerprint()).add(horizontal_blur_program->getName()).add(blur_fbo->getTexture())
+				.add(compute_blur);
+			if (horizontal_blur_stage.needsUpdate(horizontal_inputs.value())) {
+				ProfileScope scope(profiler.get(), "horizontal_blur");
+
+				//blur horizontally. The compute shader blurs at the downscaled size
+				//and is then upsampled, which gives the same result, as the blur
+				//and the bilinear upsampling are both linear.
+				if (compute_blur) {
+					std::shared_ptr<TextureFBO> scratch = target_pool.acquire(fbo2->getWidth(), fbo2->getHeight());
+					renderSeparableBlur(*fbo2, 0, *scratch, true);
+					renderFullscreenPass(*passthrough_program, *scratch, GL_TEXTURE0, *blur_fbo);
+				}
+				else renderFullscreenPass(*horizontal_blur_program, *fbo2, GL_TEXTURE0, *blur_fbo);
+				wide_blur_stage.invalidate();
+				bilateral_stage.invalidate();
+				temporal_blur_stage.invalidate();
+				split_stage.invalidate();
+				dof_stage.invalidate();
+				variable_blur_stage.invalidate();
+			}
+		}
+
+		output = blur_fbo.get();
+	}
+	else if (wide_blur) {
+		//Blur at the scene resolution, as wide as the downscaled blur
+		const float sigma = static_cast<float>(1u << downscale_level);
+		Fingerprint inputs;
+		inputs.add(output_fingerprint).add(filterMode).add(sigma).add(blur_fbo->getTexture());
+		if (wide_blur_stage.needsUpdate(inputs.value())) {
+			if (filterMode == RenderMode::RECURSIVE_BLUR) {
+				ProfileScope scope(profiler.get(), "recursive_blur");
+				renderRecursiveBlur(*output, *blur_fbo, sigma);
+			}
+			else {
+				ProfileScope scope(profiler.get(), "box_blur");
+				renderBoxBlur(*output, *blur_fbo, sigma);
+			}
+			horizontal_blur_stage.invalidate();
+			bilateral_stage.invalidate();
+			temporal_blur_stage.invalidate();
+			split_stage.invalidate();
+			dof_stage.invalidate();
+			variable_blur_stage.invalidate();
+		}
+
+		output = blur_fbo.get();
+	}
+	else if (variable_blur) {
+		Fingerprint inputs;
+		inputs.add(output_fingerprint).add(blur_fbo->getTexture());
+		if (variable_blur_stage.needsUpdate(inputs.value())) {
+			renderVariableBlur(*output, *blur_fbo);
+			horizontal_blur_stage.invalidate();
+			wide_blur_stage.invalidate();
+			bilateral_stage.invalidate();
+			temporal_blur_stage.invalidate();
+			split_stage.invalidate();
+			dof_stage.invalidate();
+		}
+
+		output = blur_fbo.get();
+	}
+	else if (filterMode == RenderMode::BILATERAL) {
+		Fingerprint inputs;
+		inputs.add(output_fingerprint).add(range_sigma).add(blur_fbo->getTexture());
+		if (bilateral_stage.needsUpdate(inputs.value())) {
+			ProfileScope scope(profiler.get(), "bilateral");
+			renderBilateralGrid(*output, *blur_fbo);
+			horizontal_blur_stage.invalidate();
+			wide_blur_stage.invalidate();
+			temporal_blur_stage.invalidate();
+			split_stage.invalidate();
+			dof_stage.invalidate();
+			variable_blur_stage.invalidate();
+		}
+
+		output = blur_fbo.get();
+	}
+	else if (filterMode == RenderMode::TONEMAP) {
+		//The exposure changes over time, so this stage is never cached.
+		//Keep rendering for a while after the scene changes, so it can adapt.
+		if (metered_fingerprint != output_fingerprint) {
+			metered_fingerprint = output_fingerprint;
+			exposure_settle_deadline = Timer::getCurrentTimeNs() + static_cast<uint64_t>(5.0f*adaptation_time*1e9f);
+		}
+		if (compute_supported) {
+			ProfileScope scope(profiler.get(), "metering");
+			renderMetering(*output);
+			if (Timer::getCurrentTimeNs() < exposure_settle_deadline) scheduler.requestRedraw();
+		}
+
+		{
+			ProfileScope scope(profiler.get(), "tonemap");
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, exposure_fbo->getTexture());
+			renderFullscreenPass(*tonemap_program, *output, GL_TEXTURE0, *blur_fbo);
+			horizontal_blur_stage.invalidate();
+			wide_blur_stage.invalidate();
+			bilateral_stage.invalidate();
+			temporal_blur_stage.invalidate();
+			split_stage.invalidate();
+			dof_stage.invalidate();
+			variable_blur_stage.invalidate();
+		}
+
+		output = blur_fbo.get();
+	}
+	else if (filterMode == RenderMode::SPLIT_VIEW) {
+		Fingerprint inputs;
+		inputs.add(output_fingerprint).add(fbo2->getTexture()).add(greyscale_fbo->getTexture()).add(blur_fbo->getTexture());
+		if (split_stage.needsUpdate(inputs.value())) {
+			renderSplitView(*output);
+
+			//It wrote parts of the other stages' targets
+			greyscale_stage.invalidate();
+			vertical_blur_stage.invalidate();
+			horizontal_blur_stage.invalidate();
+			wide_blur_stage.invalidate();
+			bilateral_stage.invalidate();
+			temporal_blur_stage.invalidate();
+			dof_stage.invalidate();
+			variable_blur_stage.invalidate();
+		}
+
+		output = blur_fbo.get();
+	}
+	else if (filterMode == RenderMode::DEPTH_OF_FIELD) {
+		Fingerprint inputs;
+		inputs.add(output_fingerprint).add(dof_fbos[0]->getTexture()).add(blur_fbo->getTexture());
+		if (dof_stage.needsUpdate(inputs.value())) {
+			renderDepthOfField(*output);
+			horizontal_blur_stage.invalidate();
+			wide_blur_stage.invalidate();
+			bilateral_stage.invalidate();
+			temporal_blur_stage.invalidate();
+			split_stage.invalidate();
+			variable_blur_stage.invalidate();
+		}
+
+		output = blur_fbo.get();
+	}
+
+	//Bloom is added while presenting, so the scene is not copied once more at
+	//full resolution. A capture needs the result in a texture, though.
+	TextureFBO* bloom = NULL;
+	if (filterMode == RenderMode::BLOOM) {
+		Fingerprint inputs;
+		inputs.add(output_fingerprint).add(bloom_fbos[0]->getTexture());
+		if (bloom_stage.needsUpdate(inputs.value()))
+			renderBloom(*output);
+		bloom = bloom_fbos[0].get();
+
+		if (capture) {
+			ProfileScope scope(profiler.get(), "bloom_composite");
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, bloom->getTexture());
+			addTraffic(bloom->getColorBytes(), 0);
+			renderFullscreenPass(*bloom_composite_program, *output, GL_TEXTURE0, *blur_fbo);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			horizontal_blur_stage.invalidate();
+			wide_blur_stage.invalidate();
+			bilateral_stage.invalidate();
+			temporal_blur_stage.invalidate();
+			split_stage.invalidate();
+			dof_stage.invalidate();
+			variable_blur_stage.invalidate();
+
+			output = blur_fbo.get();
+			bloom = NULL;
+		}
 	}
+	CHECK_GL_ERRORS();
 
 	//Set up rendering to screen
+	ProfileScope scope(profiler.get(), "present");
 	glDepthMask(GL_FALSE);
 	glViewport(0, 0, window_width, window_height);
 
-	//Render quad to screen, textured with the result of the blur operation
-	passthrough_program->use();
+	//Render quad to screen, textured with the result of the filter chain
+	if (bloom) {
+		bloom_composite_program->use();
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, bloom->getTexture());
+		addTraffic(std::min<uint64_t>(bloom->getColorBytes(), window_width*window_height*4*sizeof(float)), 0);
+	}
+	else passthrough_program->use();
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, fbo1->getTexture());
+	glBindTexture(GL_TEXTURE_2D, output->getTexture());
 	glBindVertexArray(vaos[1]);
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
+	addTraffic(std::min<uint64_t>(output->getColorBytes(), window_width*window_height*4*sizeof(float)),
+			window_width*window_height*4); //8 bit RGBA back buffer
 
 	//Unbind stuff and check for errors
 	glBindTexture(GL_TEXTURE_2D, 0);
+	if (bloom) {
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
 	glDepthMask(GL_TRUE);
 	CHECK_GL_ERRORS();
 	glBindVertexArray(0);
 	CHECK_GL_ERRORS();
+
+	//Queue an asynchronous read of the final image, at the size it was
+	//presented at, so the capture goes on across render scale changes
+	if (capture) {
+		TextureFBO* frame = output;
+		if (output->getWidth() != capture->getWidth() || output->getHeight() != capture->getHeight()) {
+			ProfileScope scope(profiler.get(), "capture_upscale");
+			if (!capture_fbo) {
+				ResourceScope resources("render");
+				capture_fbo = target_pool.acquire(capture->getWidth(), capture->getHeight());
+			}
+			renderFullscreenPass(*passthrough_program, *output, GL_TEXTURE0, *capture_fbo);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			Program::disuse();
+			CHECK_GL_ERRORS();
+			frame = capture_fbo.get();
+		}
+		addTraffic(frame->getColorBytes(), frame->getWidth()*frame->getHeight()*4);
+		capture->capture(*frame);
+	}
 }
 
-void GameManager::play() {
-	bool doExit = false;
+void GameManager::setSchedulerMode(SchedulerMode mode) {
+	int swap_interval = scheduler.setMode(mode);
+	if (SDL_GL_SetSwapInterval(swap_interval) < 0 && mode == VSYNC_LOCKED) {
+		//No vsync support, so pace ourselves at the display rate instead
+		cerr << "Vsync not supported, falling back to fixed rate: " << SDL_GetError() << endl;
+		scheduler.setMode(FIXED_RATE);
+		SDL_GL_SetSwapInterval(0);
+	}
+	std::cout << "Frame scheduler: " << FrameScheduler::getModeName(scheduler.getMode()) << std::endl;
+}
 
-	//SDL main loop
-	while (!doExit) {
-		SDL_Event event;
-		while (SDL_PollEvent(&event)) {// poll for pending events
-			switch (event.type) {
-			case SDL_MOUSEBUTTONDOWN:
-				trackball.rotateBegin(event.motion.x, event.motion.y);
-				break;
-			case SDL_MOUSEBUTTONUP:
-				trackball.rotateEnd(event.motion.x, event.motion.y);
-				break;
-			case SDL_MOUSEMOTION:
-				trackball_view_matrix = trackball.rotate(event.motion.x, event.motion.y);
-				break;
-			case SDL_KEYDOWN:
-				switch (event.key.keysym.sym) {
-				case SDLK_ESCAPE: //Esc
-					doExit = true;
-					break;
-				case SDLK_q: //Ctrl+q
-					if (event.key.keysym.mod & KMOD_CTRL) doExit = true;
-					break;
-				case SDLK_0: //Render Standar phong shading
-				{
-					std::cout << "0" << std::endl;
-					if (RenderMode::STANDARD == filterMode) break;
-					
-					fbo2.reset(new TextureFBO(window_width, window_height));
-					fbo2->unbind();
-				
-					filterMode = RenderMode::STANDARD;
-				}
-				break;
-				case SDLK_1: //Render Blur filtermode
-				{
-					std::cout << "1" << std::endl;
-					if (RenderMode::BLUR == filterMode) break;
-				
-					fbo2.reset(new TextureFBO(window_width >> downscale_level, window_height >> downscale_level));
-					fbo2->unbind();
-				
-					filterMode = RenderMode::BLUR;
-				}
-					break;
-				case SDLK_2: //Render Greyscale filtermode
-				{
-					std::cout << "2" << std::endl;
-					if (RenderMode::GREYSCALE == filterMode) break;
+void GameManager::toggleCapture(CaptureFormat format) {
+	if (capture) {
+		capture.reset(); //Flushes the frames in flight
+		capture_fbo.reset();
+		return;
+	}
+
+	std::string path = (format == CAPTURE_Y4M) ? "capture.y4m" : "capture";
+	capture.reset(new FrameCapture(window_width, window_height, format, path));
+	std::cout << "Capturing to " << path << std::endl;
+}
+
+bool GameManager::translateEvent(const SDL_Event& event, InputEvent& input) {
+	input.timestamp = Timer::getCurrentTimeNs();
+	input.mod = 0;
+	input.x = 0;
+	input.y = 0;
+
+	switch (event.type) {
+	case SDL_MOUSEBUTTONDOWN:
+		input.type = INPUT_ROTATE_BEGIN;
+		input.x = event.button.x;
+		input.y = event.button.y;
+		return true;
+	case SDL_MOUSEBUTTONUP:
+		input.type = INPUT_ROTATE_END;
+		input.x = event.button.x;
+		input.y = event.button.y;
+		return true;
+	case SDL_MOUSEMOTION:
+		input.type = INPUT_MOTION;
+		input.x = event.motion.x;
+		input.y = event.motion.y;
+		return true;
+	case SDL_WINDOWEVENT:
+		if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+			input.type = INPUT_RESIZE;
+			input.x = event.window.data1;
+			input.y = event.window.data2;
+		}
+		else input.type = INPUT_REDRAW; //Exposed, restored etc.
+		return true;
+	case SDL_KEYDOWN:
+		input.type = INPUT_KEY;
+		input.x = event.key.keysym.sym;
+		input.mod = event.key.keysym.mod;
+		return true;
+	case SDL_QUIT: //e.g., user clicks the upper right x
+		input.type = INPUT_QUIT;
+		return true;
+	default:
+		return false;
+	}
+}
+
+void GameManager::handleInput(const InputEvent& event, bool& doExit) {
+	if (recording) recording->add(frame_index, event);
+
+	switch (event.type) {
+	case INPUT_ROTATE_BEGIN:
+		trackball.rotateBegin(event.x, event.y);
+		break;
+	case INPUT_ROTATE_END:
+		trackball.rotateEnd(event.x, event.y);
+		trackball_view_matrix = trackball.rotate(event.x, event.y);
+		scheduler.requestRedraw();
+		break;
+	case INPUT_MOTION:
+		if (!trackball.isRotating()) break; //Camera does not move, nothing to redraw
+		trackball_view_matrix = trackball.rotate(event.x, event.y);
+		++trackball_updates;
+		scheduler.requestRedraw();
+		break;
+	case INPUT_REDRAW:
+		scheduler.requestRedraw();
+		break;
+	case INPUT_RESIZE:
+		if (event.x <= 0 || event.y <= 0) break; //Minimized
+
+		//Present the old targets stretched to the new size right away, but
+		//wait until the size has settled before reallocating them
+		window_width = event.x;
+		window_height = event.y;
+		trackball.setWindowSize(window_width, window_height);
+		resize_pending = true;
+		resize_deadline = event.timestamp + resize_debounce_ms*1000000ull;
+		if (replay) resize_deadline = UINT64_MAX; //Reallocated when the recording did
+		scheduler.requestRedraw();
+		break;
+	case INPUT_RESIZE_SETTLED:
+		resizeTargets();
+		break;
+	case INPUT_RENDER_SCALE:
+	{
+		float scale;
+		memcpy(&scale, &event.x, sizeof(float));
+		setRenderScale(scale, event.y);
+	}
+		break;
+	case INPUT_KEY:
+		handleKey(event.x, event.mod, doExit);
+		break;
+	case INPUT_QUIT:
+		doExit = true;
+		break;
+	}
+}
+
+void GameManager::handleKey(int key, unsigned int mod, bool& doExit) {
+	switch (key) {
+	case SDLK_ESCAPE: //Esc
+		doExit = true;
+		break;
+	case SDLK_q: //Ctrl+q
+		if (mod & KMOD_CTRL) doExit = true;
+		break;
+	case SDLK_c: //Start or stop capturing, Shift+c for a png sequence
+		toggleCapture((mod & KMOD_SHIFT) ? CAPTURE_PNG : CAPTURE_Y4M);
+		break;
+	case SDLK_r: //Toggle dynamic resolution scaling
+		toggleDynamicResolution();
+		break;
+	case SDLK_a: //Start or stop counting heap allocations in render()
+		toggleAllocationTracking();
+		break;
+	case SDLK_p: //Print the time, invocations and memory traffic of each pass
+		if (!profiler) profiler.reset(new PassProfiler());
+		print_statistics = true;
+		scheduler.requestRedraw();
+		break;
+	case SDLK_v: //Print the GL objects alive and the memory they hold
+		ResourceRegistry::dump(std::cout);
+		break;
+	case SDLK_l: //Toggle deferred shading, Shift+l for four times the lights
+		if (mod & KMOD_SHIFT) setDeferredShading(true, (light_count >= max_lights) ? 16 : light_count*4);
+		else setDeferredShading(!deferred_shading, light_count);
+		break;
+	case SDLK_f: //Render depth of field, Shift+f to gather it at half or a quarter of the resolution
+		if (mod & KMOD_SHIFT) {
+			setDepthOfFieldLevel(dof_downscale_level == 1 ? 2 : 1);
+			break;
+		}
+		std::cout << "f: depth of field" << std::endl;
+		if (RenderMode::DEPTH_OF_FIELD == filterMode) break;
+
+		filterMode = RenderMode::DEPTH_OF_FIELD;
+		scheduler.requestRedraw();
+		break;
+	case SDLK_b: //Render bloom
+		std::cout << "b: bloom" << std::endl;
+		if (RenderMode::BLOOM == filterMode) break;
+
+		filterMode = RenderMode::BLOOM;
+		scheduler.requestRedraw();
+		break;
+	case SDLK_x: //Cycle through no antialiasing, MSAA and FXAA
+		setAntialiasing(static_cast<Antialiasing>((antialiasing + 1) % ANTIALIAS_COUNT));
+		break;
+	case SDLK_k: //Switch the downscaled blur between fragment and compute shaders
+		setComputeBlur(!compute_blur);
+		break;
+	case SDLK_s: //Render a box blur growing with the distance from the focus
+		std::cout << "s: variable blur" << std::endl;
+		if (RenderMode::VARIABLE_BLUR == filterMode) break;
+
+		filterMode = RenderMode::VARIABLE_BLUR;
+		scheduler.requestRedraw();
+		break;
+	case SDLK_m: //Cycle through the frame scheduler modes
+		setSchedulerMode(static_cast<SchedulerMode>((scheduler.getMode() + 1) % (ON_DEMAND + 1)));
+		break;
+	case SDLK_0: //Render Standar phong shading
+	{
+		std::cout << "0" << std::endl;
+		if (RenderMode::STANDARD == filterMode) break;
+
+		filterMode = RenderMode::STANDARD;
+		scheduler.requestRedraw();
+	}
+	break;
+	case SDLK_1: //Render Blur filtermode
+	{
+		std::cout << "1" << std::endl;
+		if (RenderMode::BLUR == filterMode) break;
+
+		filterMode = RenderMode::BLUR;
+		scheduler.requestRedraw();
+	}
+		break;
+	case SDLK_2: //Render Greyscale filtermode
+	{
+		std::cout << "2" << std::endl;
+		if (RenderMode::GREYSCALE == filterMode) break;
+
+		filterMode = RenderMode::GREYSCALE;
+		scheduler.requestRedraw();
+	}
+		break;
+	case SDLK_3: //Render Greyscale and Blur
+	{
+		std::cout << "3" << std::endl; 
+		if (RenderMode::COMBO == filterMode) break;
+
+		filterMode = RenderMode::COMBO;
+		scheduler.requestRedraw();
+	}
+		break;
+	case SDLK_4: //Render recursive Gaussian blur
+	{
+		std::cout << "4" << std::endl;
+		if (RenderMode::RECURSIVE_BLUR == filterMode) break;
+
+		filterMode = RenderMode::RECURSIVE_BLUR;
+		scheduler.requestRedraw();
+	}
+		break;
+	case SDLK_5: //Render box cascade blur
+	{
+		std::cout << "5" << std::endl;
+		if (RenderMode::BOX_BLUR == filterMode) break;
+
+		filterMode = RenderMode::BOX_BLUR;
+		scheduler.requestRedraw();
+	}
+		break;
+	case SDLK_6: //Render edge preserving bilateral blur
+	{
+		std::cout << "6" << std::endl;
+		if (RenderMode::BILATERAL == filterMode) break;
+
+		filterMode = RenderMode::BILATERAL;
+		scheduler.requestRedraw();
+	}
+		break;
+	case SDLK_7: //Render with auto exposure and tone mapping
+	{
+		std::cout << "7" << std::endl;
+		if (RenderMode::TONEMAP == filterMode) break;
+
+		filterMode = RenderMode::TONEMAP;
+		scheduler.requestRedraw();
+	}
+		break;
+	case SDLK_8: //Render blur reusing the last frame
+	{
+		std::cout << "8" << std::endl;
+		if (RenderMode::TEMPORAL_BLUR == filterMode) break;
 
+		filterMode = RenderMode::TEMPORAL_BLUR;
+		scheduler.requestRedraw();
+	}
+		break;
+	case SDLK_9: //Render standard, blur, greyscale and combo side by side
+	{
+		std::cout << "9: standard | blur" << std::endl;
+		std::cout << "   greyscale | combo" << std::endl;
+		if (RenderMode::SPLIT_VIEW == filterMode) break;
 
-					fbo2.reset(new TextureFBO(window_width, window_height));
-					fbo2->unbind();
+		filterMode = RenderMode::SPLIT_VIEW;
+		scheduler.requestRedraw();
+	}
+		break;
+	}
+}
 
+void GameManager::renderLoop() {
+	Tracer::setThreadName("render");
+	try {
+		SDL_GL_MakeCurrent(main_window, main_context);
+		setSchedulerMode(scheduler.getMode());
+		if (recording) {
+			InputTrace::State state;
+			state.width = window_width;
+			state.height = window_height;
+			state.render_mode = filterMode;
+			state.downscale_level = downscale_level;
+			recording->setInitialState(state);
+		}
 
-					filterMode = RenderMode::GREYSCALE;
+		bool doExit = false;
+		while (!doExit) {
+			//Sleep until there is input, or the scheduler wants a frame
+			int timeout = scheduler.getWaitTimeout();
+			if (resize_pending) {
+				uint64_t now = Timer::getCurrentTimeNs();
+				int resize_timeout = (now >= resize_deadline) ? 0 : static_cast<int>((resize_deadline - now) / 1000000) + 1;
+				timeout = (timeout < 0) ? resize_timeout : std::min(timeout, resize_timeout);
+			}
+			if (replay) timeout = 0; //Replay as fast as possible
+			if (timeout != 0) {
+				TRACE_SCOPE("wait");
+				std::unique_lock<std::mutex> lock(wake_mutex);
+				if (timeout < 0) wake_render.wait(lock, [this] { return !input_queue.empty(); });
+				else wake_render.wait_for(lock, std::chrono::milliseconds(timeout), [this] { return !input_queue.empty(); });
+			}
+
+			InputEvent event, motion;
+			if (replay) {
+				//Only let live input stop the replay
+				while (input_queue.pop(event)) {
+					if (event.type == INPUT_QUIT || (event.type == INPUT_KEY && event.x == SDLK_ESCAPE))
+						doExit = true;
+				}
+
+				//Apply what the recording applied before this frame, and render it
+				while (replay->next(frame_index, event))
+					handleInput(event, doExit);
+				scheduler.requestRedraw();
+			}
+			else {
+				//Handle everything that arrived since the last frame. Runs of
+				//motion events only move the trackball to the last position.
+				bool has_motion = false;
+				while (input_queue.pop(event)) {
+					if (event.type == INPUT_MOTION) {
+						motion = event;
+						has_motion = true;
+						++motion_events;
+						continue;
+					}
+					if (has_motion) handleInput(motion, doExit);
+					has_motion = false;
+					handleInput(event, doExit);
 				}
-					break;
-				case SDLK_3: //Render Greyscale and Blur
-				{
-					std::cout << "3" << std::endl; 
-					if (RenderMode::COMBO == filterMode) break;
+				if (has_motion) handleInput(motion, doExit);
+
+				//Reallocate once the window has stopped changing size
+				if (resize_pending && Timer::getCurrentTimeNs() >= resize_deadline) {
+					InputEvent settled = {INPUT_RESIZE_SETTLED, 0, 0, 0, Timer::getCurrentTimeNs()};
+					handleInput(settled, doExit);
+				}
+			}
 
-					fbo2.reset(new TextureFBO(window_width >> downscale_level, window_height >> downscale_level));
-					fbo2->unbind();
+			//Render, and swap front and back buffers
+			if (!doExit && scheduler.shouldRender()) {
+				TRACE_SCOPE("frame");
+				scheduler.beginFrame();
+				if (profiler) profiler->beginFrame();
+				if (track_allocations) {
+					AllocationScope scope("render");
+					AllocationTracker::setEnabled(true);
+					render();
+					AllocationTracker::setEnabled(false);
+					++tracked_frames;
+				}
+				else render();
+				if (profiler) profiler->endFrame();
+				TRACE_SCOPE("swap");
+				SDL_GL_SwapWindow(main_window);
+				scheduler.endFrame();
+				++frame_index;
+			}
+			if (replay && replay->finished()) doExit = true;
+			if (print_statistics) scheduler.requestRedraw(); //Until a profiled frame is back
 
-					filterMode = RenderMode::COMBO;
+			//Adapt the resolution to the GPU times of finished frames
+			PassTimings timings;
+			while (profiler && profiler->collect(timings)) {
+				if (print_statistics && timings.n_passes > 0) {
+					timings.print(std::cout);
+					print_statistics = false;
 				}
-					break;
+				if (replay) continue; //The recorded scale changes are replayed instead
+				if (resolution_controller && resolution_controller->update(timings.total)) {
+					//Applied as an event, so recordings replay the same scale
+					InputEvent scale_event = {INPUT_RENDER_SCALE, 0, 0, 0, Timer::getCurrentTimeNs()};
+					const float scale = resolution_controller->getScale();
+					memcpy(&scale_event.x, &scale, sizeof(float));
+					scale_event.y = resolution_controller->getDownscaleLevel();
+					handleInput(scale_event, doExit);
+					std::cout << "Render scale " << render_scale << ", downscale level " << downscale_level
+						<< " (" << resolution_controller->getSmoothedFrameTime() << " ms)" << std::endl;
 				}
-				break;
-			case SDL_QUIT: //e.g., user clicks the upper right x
-				doExit = true;
-				break;
 			}
 		}
+		quit();
+	}
+	catch (...) {
+		render_error = std::current_exception();
+	}
+
+	//Hand the context back, and wake up the event loop
+	SDL_GL_MakeCurrent(main_window, NULL);
+	running = false;
+	SDL_Event quit_event;
+	quit_event.type = SDL_QUIT;
+	SDL_PushEvent(&quit_event);
+}
+
+void GameManager::play() {
+	//The render thread owns the context while it runs
+	SDL_GL_MakeCurrent(main_window, NULL);
+	running = true;
+	frame_index = 0;
+	motion_events = 0;
+	trackball_updates = 0;
+	render_thread = std::thread(&GameManager::renderLoop, this);
 
-		//Render, and swap front and back buffers
-		render();
-		SDL_GL_SwapWindow(main_window);
+	//SDL main loop: only translates events and passes them on
+	while (running) {
+		SDL_Event event;
+		if (!SDL_WaitEvent(&event)) continue;
+
+		InputEvent input;
+		if (!translateEvent(event, input)) continue;
+		while (!input_queue.push(input) && running) {
+			if (input.type == INPUT_MOTION) break; //A newer position will follow
+			std::this_thread::yield();
+		}
+
+		//Lock, so the render thread cannot miss the wake up between
+		//checking the queue and going to sleep
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex);
+		}
+		wake_render.notify_one();
 	}
-	quit();
+
+	render_thread.join();
+	SDL_GL_MakeCurrent(main_window, main_context);
+	if (render_error) std::rethrow_exception(render_error);
 }
 
 void GameManager::quit() {
+	capture.reset();
+	if (track_allocations) toggleAllocationTracking();
+	if (recording) {
+		recording->save(recording_filename);
+		std::cout << "Recorded " << recording->size() << " input events over " << frame_index
+			<< " frames to " << recording_filename << std::endl;
+	}
+	FrameStats stats = scheduler.getStats();
+	std::cout << "Rendered " << stats.frames << " frames, frame time (ms) mean " << stats.mean
+		<< " min " << stats.min << " p50 " << stats.p50 << " p95 " << stats.p95
+		<< " p99 " << stats.p99 << " max " << stats.max << std::endl;
+	std::cout << "Coalesced " << motion_events << " mouse motion events into "
+		<< trackball_updates << " trackball updates" << std::endl;
 	std::cout << "Bye bye..." << std::endl;
 }
@@ -0,0 +1,233 @@
+#include "ImageIO.h"
+#include "GameException.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+	inline void putBigEndian(unsigned char* p, unsigned int v) {
+		p[0] = (v >> 24) & 0xff;
+		p[1] = (v >> 16) & 0xff;
+		p[2] = (v >> 8) & 0xff;
+		p[3] = v & 0xff;
+	}
+
+	inline unsigned char clampByte(float v) {
+		return static_cast<unsigned char>(std::min(std::max(v + 0.5f, 0.0f), 255.0f));
+	}
+
+	struct CRCTable {
+		CRCTable() {
+			for (unsigned int n=0; n<256; ++n) {
+				unsigned int c = n;
+				for (int k=0; k<8; ++k)
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+		}
+		unsigned int table[256];
+	};
+}
+
+const unsigned char* ImageIO::readHeaderValue(const unsigned char* p, const unsigned char* end, unsigned int& value) {
+	//Values are separated by whitespace, and comments run to the end of the line
+	while (p < end && (std::isspace(*p) || *p == '#')) {
+		if (*p == '#') while (p < end && *p != '\n') ++p;
+		else ++p;
+	}
+
+	if (p == end || !std::isdigit(*p)) THROW_EXCEPTION("Malformed PNM header");
+	value = 0;
+	while (p < end && std::isdigit(*p)) {
+		value = value*10 + (*p - '0');
+		++p;
+	}
+	return p;
+}
+
+size_t ImageIO::readPNMHeader(const unsigned char* data, size_t bytes, unsigned int& width, unsigned int& height,
+		unsigned int& channels, unsigned int& max_value) {
+	if (bytes < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6'))
+		THROW_EXCEPTION("Not a binary PGM or PPM");
+	channels = (data[1] == '6') ? 3 : 1;
+
+	const unsigned char* end = data + bytes;
+	const unsigned char* p = readHeaderValue(data+2, end, width);
+	p = readHeaderValue(p, end, height);
+	p = readHeaderValue(p, end, max_value);
+	if (width == 0 || height == 0 || max_value == 0 || max_value > 255)
+		THROW_EXCEPTION("Unsupported PNM size or sample depth");
+
+	//A single whitespace separates the header from the samples
+	const size_t offset = (p - data) + 1;
+	if (offset > bytes || bytes - offset < static_cast<size_t>(width)*height*channels)
+		THROW_EXCEPTION("Truncated PNM");
+	return offset;
+}
+
+void ImageIO::expandPNM(const unsigned char* samples, unsigned int channels, unsigned int max_value,
+		unsigned char* rgba, size_t pixels) {
+	for (size_t i=0; i<pixels; ++i) {
+		const unsigned char* src = samples + i*channels;
+		unsigned char* dst = rgba + i*4;
+		for (unsigned int c=0; c<3; ++c) {
+			const unsigned int v = src[channels == 3 ? c : 0];
+			dst[c] = static_cast<unsigned char>(max_value == 255 ? v : v*255u / max_value);
+		}
+		dst[3] = 255;
+	}
+}
+
+void ImageIO::readPNM(const std::string& filename, unsigned int& width, unsigned int& height,
+		std::vector<unsigned char>& rgba) {
+	MappedFile file(filename);
+
+	unsigned int channels, max_value;
+	const size_t offset = readPNMHeader(file.getData(), file.getSize(), width, height, channels, max_value);
+
+	const size_t pixels = static_cast<size_t>(width)*height;
+	rgba.resize(pixels*4);
+	expandPNM(file.getData() + offset, channels, max_value, &rgba[0], pixels);
+}
+
+unsigned int ImageIO::crc32(unsigned int crc, const unsigned char* data, size_t bytes) {
+	static const CRCTable crc_table; //Thread safe initialisation, the writers run on worker threads
+
+	crc = ~crc;
+	for (size_t i=0; i<bytes; ++i)
+		crc = crc_table.table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+void ImageIO::writeChunk(std::ofstream& file, const char type[4], const unsigned char* data, size_t bytes) {
+	unsigned char header[8];
+	putBigEndian(header, static_cast<unsigned int>(bytes));
+	std::copy(type, type+4, header+4);
+
+	unsigned int crc = crc32(0, header+4, 4);
+	crc = crc32(crc, data, bytes);
+	unsigned char footer[4];
+	putBigEndian(footer, crc);
+
+	file.write(reinterpret_cast<char*>(header), 8);
+	file.write(reinterpret_cast<const char*>(data), bytes);
+	file.write(reinterpret_cast<char*>(footer), 4);
+}
+
+void ImageIO::writePNG(const std::string& filename, unsigned int width, unsigned int height,
+		const unsigned char* rgba, bool flip_y, bool alpha) {
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file.good()) {
+		std::string err = "Could not open ";
+		err.append(filename);
+		THROW_EXCEPTION(err);
+	}
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	file.write(reinterpret_cast<const char*>(signature), 8);
+
+	unsigned char ihdr[13];
+	putBigEndian(ihdr, width);
+	putBigEndian(ihdr+4, height);
+	ihdr[8] = 8; //Bit depth
+	ihdr[9] = alpha ? 6 : 2; //Colour type RGBA or RGB
+	ihdr[10] = 0; //Deflate
+	ihdr[11] = 0; //Adaptive filtering
+	ihdr[12] = 0; //No interlace
+	writeChunk(file, "IHDR", ihdr, sizeof(ihdr));
+
+	//Raw scanlines, each prefixed by filter type 0 (none)
+	const unsigned int channels = alpha ? 4 : 3;
+	const size_t row_bytes = width*channels;
+	const size_t raw_bytes = (row_bytes+1)*height;
+	const size_t max_block = 65535;
+	const size_t n_blocks = std::max<size_t>(1, (raw_bytes + max_block - 1) / max_block);
+
+	std::vector<unsigned char> idat;
+	idat.reserve(2 + raw_bytes + 5*n_blocks + 4);
+	idat.push_back(0x78); //zlib header, 32K window, no compression
+	idat.push_back(0x01);
+
+	std::vector<unsigned char> raw(raw_bytes);
+	for (unsigned int y=0; y<height; ++y) {
+		unsigned int src_row = flip_y ? height-1-y : y;
+		raw[y*(row_bytes+1)] = 0;
+		const unsigned char* src = rgba + src_row*width*4;
+		unsigned char* dst = &raw[y*(row_bytes+1) + 1];
+		if (alpha) {
+			std::copy(src, src + row_bytes, dst);
+			continue;
+		}
+		for (unsigned int x=0; x<width; ++x) {
+			dst[x*3] = src[x*4];
+			dst[x*3+1] = src[x*4+1];
+			dst[x*3+2] = src[x*4+2];
+		}
+	}
+
+	//Adler-32 of the uncompressed data
+	unsigned int a = 1, b = 0;
+	for (size_t i=0; i<raw_bytes; ++i) {
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	size_t offset = 0;
+	do {
+		size_t len = std::min(max_block, raw_bytes-offset);
+		bool last = offset+len >= raw_bytes;
+		idat.push_back(last ? 1 : 0);
+		idat.push_back(len & 0xff);
+		idat.push_back((len >> 8) & 0xff);
+		idat.push_back(~len & 0xff);
+		idat.push_back((~len >> 8) & 0xff);
+		idat.insert(idat.end(), raw.begin()+offset, raw.begin()+offset+len);
+		offset += len;
+	} while (offset < raw_bytes);
+	unsigned char adler[4];
+	putBigEndian(adler, (b << 16) | a);
+	idat.insert(idat.end(), adler, adler+4);
+
+	writeChunk(file, "IDAT", idat.data(), idat.size());
+	writeChunk(file, "IEND", NULL, 0);
+}
+
+Y4MWriter::Y4MWriter(const std::string& filename, unsigned int width, unsigned int height, unsigned int fps) {
+	this->width = width;
+	this->height = height;
+	planes.resize(width*height*3);
+
+	file.open(filename.c_str(), std::ios::binary);
+	if (!file.good()) {
+		std::string err = "Could not open ";
+		err.append(filename);
+		THROW_EXCEPTION(err);
+	}
+	file << "YUV4MPEG2 W" << width << " H" << height << " F" << fps << ":1 Ip A1:1 C444\n";
+}
+
+Y4MWriter::~Y4MWriter() {
+	file.close();
+}
+
+void Y4MWriter::writeFrame(const unsigned char* rgba, bool flip_y) {
+	unsigned char* y_plane = &planes[0];
+	unsigned char* cb_plane = y_plane + width*height;
+	unsigned char* cr_plane = cb_plane + width*height;
+
+	//BT.601 studio range, which is what players assume for untagged y4m
+	for (unsigned int y=0; y<height; ++y) {
+		const unsigned char* src = rgba + (flip_y ? height-1-y : y)*width*4;
+		for (unsigned int x=0; x<width; ++x) {
+			float r = src[4*x], g = src[4*x+1], b = src[4*x+2];
+			unsigned int i = y*width + x;
+			y_plane[i] = clampByte(16.0f + 0.256788f*r + 0.504129f*g + 0.097906f*b);
+			cb_plane[i] = clampByte(128.0f - 0.148223f*r - 0.290993f*g + 0.439216f*b);
+			cr_plane[i] = clampByte(128.0f + 0.439216f*r - 0.367788f*g - 0.071427f*b);
+		}
+	}
+
+	file << "FRAME\n";
+	file.write(reinterpret_cast<char*>(&planes[0]), planes.size());
+}
@@ -0,0 +1,134 @@
+#include "InputTrace.h"
+#include "GameException.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace {
+	const char trace_magic[4] = {'G', 'L', 'I', 'T'};
+	const unsigned char trace_version = 1;
+
+	void putVarint(std::vector<unsigned char>& out, uint64_t v) {
+		while (v >= 0x80) {
+			out.push_back(static_cast<unsigned char>(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back(static_cast<unsigned char>(v));
+	}
+
+	//Zigzag encoding, so small negative numbers stay short too
+	void putSignedVarint(std::vector<unsigned char>& out, int64_t v) {
+		putVarint(out, (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+	}
+
+	uint64_t getVarint(const std::vector<unsigned char>& in, size_t& pos) {
+		uint64_t v = 0;
+		for (unsigned int shift=0; shift<64; shift+=7) {
+			if (pos >= in.size()) THROW_EXCEPTION("Input trace is truncated");
+			const unsigned char byte = in[pos++];
+			v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) return v;
+		}
+		THROW_EXCEPTION("Input trace is corrupt");
+	}
+
+	int64_t getSignedVarint(const std::vector<unsigned char>& in, size_t& pos) {
+		const uint64_t v = getVarint(in, pos);
+		return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+	}
+}
+
+InputTrace::InputTrace() {
+	position = 0;
+	initial_state.width = 0;
+	initial_state.height = 0;
+	initial_state.render_mode = 0;
+	initial_state.downscale_level = 0;
+}
+
+void InputTrace::add(uint32_t frame, const InputEvent& event) {
+	Entry entry;
+	entry.frame = frame;
+	entry.event = event;
+	entries.push_back(entry);
+}
+
+bool InputTrace::next(uint32_t frame, InputEvent& event) {
+	if (finished() || entries[position].frame > frame) return false;
+	event = entries[position++].event;
+	return true;
+}
+
+void InputTrace::save(const std::string& filename) const {
+	std::vector<unsigned char> data(trace_magic, trace_magic+4);
+	data.push_back(trace_version);
+	putVarint(data, initial_state.width);
+	putVarint(data, initial_state.height);
+	putVarint(data, initial_state.render_mode);
+	putVarint(data, initial_state.downscale_level);
+	putVarint(data, entries.size());
+
+	uint32_t frame = 0;
+	uint64_t timestamp = entries.empty() ? 0 : entries[0].event.timestamp;
+	putVarint(data, timestamp);
+	for (size_t i=0; i<entries.size(); ++i) {
+		const Entry& entry = entries[i];
+		putVarint(data, entry.frame - frame);
+		data.push_back(entry.event.type);
+		putVarint(data, entry.event.mod);
+		putSignedVarint(data, entry.event.x);
+		putSignedVarint(data, entry.event.y);
+		putSignedVarint(data, static_cast<int64_t>(entry.event.timestamp - timestamp));
+		frame = entry.frame;
+		timestamp = entry.event.timestamp;
+	}
+
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if (!file.good()) {
+		std::string err = "Could not open ";
+		err.append(filename);
+		THROW_EXCEPTION(err);
+	}
+	file.write(reinterpret_cast<const char*>(&data[0]), data.size());
+}
+
+void InputTrace::load(const std::string& filename) {
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file.good()) {
+		std::string err = "Could not open ";
+		err.append(filename);
+		THROW_EXCEPTION(err);
+	}
+	std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (data.size() < 5 || !std::equal(trace_magic, trace_magic+4, data.begin()) || data[4] != trace_version) {
+		std::string err = filename;
+		err.append(" is not an input trace");
+		THROW_EXCEPTION(err);
+	}
+
+	size_t pos = 5;
+	initial_state.width = static_cast<uint32_t>(getVarint(data, pos));
+	initial_state.height = static_cast<uint32_t>(getVarint(data, pos));
+	initial_state.render_mode = static_cast<uint32_t>(getVarint(data, pos));
+	initial_state.downscale_level = static_cast<uint32_t>(getVarint(data, pos));
+	const uint64_t count = getVarint(data, pos);
+
+	entries.clear();
+	position = 0;
+	uint32_t frame = 0;
+	uint64_t timestamp = getVarint(data, pos);
+	for (uint64_t i=0; i<count; ++i) {
+		Entry entry;
+		frame += static_cast<uint32_t>(getVarint(data, pos));
+		entry.frame = frame;
+		if (pos >= data.size()) THROW_EXCEPTION("Input trace is truncated");
+		entry.event.type = data[pos++];
+		entry.event.mod = static_cast<uint16_t>(getVarint(data, pos));
+		entry.event.x = static_cast<int32_t>(getSignedVarint(data, pos));
+		entry.event.y = static_cast<int32_t>(getSignedVarint(data, pos));
+		timestamp += static_cast<uint64_t>(getSignedVarint(data, pos));
+		entry.event.timestamp = timestamp;
+		entries.push_back(entry);
+	}
+}
@@ -0,0 +1,136 @@
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LIGHTCLUSTERS_SSE
+#include <xmmintrin.h>
+#endif
+
+LightClusters::LightClusters() {
+	z_near = 1.0f;
+	z_far = 2.0f;
+	max_lights = 0;
+	clusters.resize(2*cluster_count, 0);
+	min_x.resize(cluster_count, 0.0f);
+	min_y.resize(cluster_count, 0.0f);
+	min_z.resize(cluster_count, 0.0f);
+	max_x.resize(cluster_count, 0.0f);
+	max_y.resize(cluster_count, 0.0f);
+	max_z.resize(cluster_count, 0.0f);
+}
+
+void LightClusters::setProjection(const glm::mat4& projection, float z_near, float z_far) {
+	this->z_near = z_near;
+	this->z_far = z_far;
+	const glm::mat4 inverse_projection = glm::inverse(projection);
+
+	for (unsigned int k=0; k<slices; ++k) {
+		//Exponential slices, so the clusters are about as deep as they are wide
+		const float d0 = z_near * std::pow(z_far / z_near, k / static_cast<float>(slices));
+		const float d1 = z_near * std::pow(z_far / z_near, (k+1) / static_cast<float>(slices));
+
+		for (unsigned int j=0; j<tiles_y; ++j) {
+			for (unsigned int i=0; i<tiles_x; ++i) {
+				const unsigned int c = i + tiles_x*(j + tiles_y*k);
+				glm::vec3 lo(1e30f), hi(-1e30f);
+
+				//The box around the tile's four corner rays, between the two depths
+				for (unsigned int corner=0; corner<4; ++corner) {
+					const float x = -1.0f + 2.0f*(i + (corner & 1)) / tiles_x;
+					const float y = -1.0f + 2.0f*(j + (corner >> 1)) / tiles_y;
+					glm::vec4 p = inverse_projection * glm::vec4(x, y, -1.0f, 1.0f);
+					glm::vec3 ray = glm::vec3(p) / p.w;
+					ray = ray / -ray.z;
+					lo = glm::min(lo, glm::min(ray*d0, ray*d1));
+					hi = glm::max(hi, glm::max(ray*d0, ray*d1));
+				}
+
+				min_x[c] = lo.x;
+				min_y[c] = lo.y;
+				min_z[c] = lo.z;
+				max_x[c] = hi.x;
+				max_y[c] = hi.y;
+				max_z[c] = hi.z;
+			}
+		}
+	}
+}
+
+void LightClusters::assign(const glm::vec4* lights, unsigned int count) {
+	indices.clear();
+	max_lights = 0;
+
+	for (unsigned int k=0; k<slices; ++k) {
+		const float d0 = z_near * std::pow(z_far / z_near, k / static_cast<float>(slices));
+		const float d1 = z_near * std::pow(z_far / z_near, (k+1) / static_cast<float>(slices));
+
+		//Only the lights that reach into the slice are tested against its clusters
+		light_x.clear();
+		light_y.clear();
+		light_z.clear();
+		light_r2.clear();
+		light_index.clear();
+		for (unsigned int l=0; l<count; ++l) {
+			const float distance = -lights[l].z;
+			const float radius = lights[l].w;
+			if (distance + radius < d0 || distance - radius > d1) continue;
+			light_x.push_back(lights[l].x);
+			light_y.push_back(lights[l].y);
+			light_z.push_back(lights[l].z);
+			light_r2.push_back(radius*radius);
+			light_index.push_back(l);
+		}
+		while (light_index.size() % 4 != 0) {
+			light_x.push_back(0.0f);
+			light_y.push_back(0.0f);
+			light_z.push_back(0.0f);
+			light_r2.push_back(-1.0f); //Never within reach, as the distance is at least zero
+			light_index.push_back(0);
+		}
+
+		for (unsigned int c=k*tiles_x*tiles_y; c<(k+1)*tiles_x*tiles_y; ++c) {
+			const unsigned int offset = static_cast<unsigned int>(indices.size());
+			const unsigned int lights_in_cluster = light_index.empty() ? 0 : cullCluster(c);
+			clusters[2*c] = offset;
+			clusters[2*c+1] = lights_in_cluster;
+			max_lights = std::max(max_lights, lights_in_cluster);
+		}
+	}
+}
+
+unsigned int LightClusters::cullCluster(unsigned int c) {
+	const unsigned int before = static_cast<unsigned int>(indices.size());
+	const unsigned int n = static_cast<unsigned int>(light_index.size());
+
+	//Squared distance from each light to the box, four lights at a time
+#ifdef LIGHTCLUSTERS_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 x0 = _mm_set1_ps(min_x[c]), x1 = _mm_set1_ps(max_x[c]);
+	const __m128 y0 = _mm_set1_ps(min_y[c]), y1 = _mm_set1_ps(max_y[c]);
+	const __m128 z0 = _mm_set1_ps(min_z[c]), z1 = _mm_set1_ps(max_z[c]);
+	for (unsigned int l=0; l<n; l+=4) {
+		const __m128 x = _mm_loadu_ps(&light_x[l]);
+		const __m128 y = _mm_loadu_ps(&light_y[l]);
+		const __m128 z = _mm_loadu_ps(&light_z[l]);
+		const __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(x0, x), zero), _mm_max_ps(_mm_sub_ps(x, x1), zero));
+		const __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(y0, y), zero), _mm_max_ps(_mm_sub_ps(y, y1), zero));
+		const __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(z0, z), zero), _mm_max_ps(_mm_sub_ps(z, z1), zero));
+		const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		const int mask = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_loadu_ps(&light_r2[l])));
+		if (mask == 0) continue;
+		for (unsigned int i=0; i<4; ++i)
+			if (mask & (1 << i)) indices.push_back(light_index[l+i]);
+	}
+#else
+	for (unsigned int l=0; l<n; ++l) {
+		const float dx = std::max(min_x[c] - light_x[l], 0.0f) + std::max(light_x[l] - max_x[c], 0.0f);
+		const float dy = std::max(min_y[c] - light_y[l], 0.0f) + std::max(light_y[l] - max_y[c], 0.0f);
+		const float dz = std::max(min_z[c] - light_z[l], 0.0f) + std::max(light_z[l] - max_z[c], 0.0f);
+		if (dx*dx + dy*dy + dz*dz <= light_r2[l]) indices.push_back(light_index[l]);
+	}
+#endif
+
+	return static_cast<unsigned int>(indices.size()) - before;
+}
@@ -0,0 +1,108 @@
+#include "MappedFile.h"
+#include "GameException.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filename) {
+	size = 0;
+	map(filename, false);
+}
+
+MappedFile::MappedFile(const std::string& filename, size_t size) {
+	this->size = size;
+	map(filename, true);
+}
+
+#ifdef _WIN32
+
+void MappedFile::map(const std::string& filename, bool writable) {
+	data = NULL;
+	mapping = NULL;
+	file = CreateFileA(filename.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+			FILE_SHARE_READ, NULL, writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) THROW_EXCEPTION("Could not open " + filename);
+
+	if (!writable) {
+		LARGE_INTEGER file_size;
+		GetFileSizeEx(file, &file_size);
+		size = static_cast<size_t>(file_size.QuadPart);
+	}
+	const unsigned long long bytes = size;
+	mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+			static_cast<DWORD>(bytes >> 32), static_cast<DWORD>(bytes), NULL);
+	if (mapping != NULL)
+		data = static_cast<unsigned char*>(MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size));
+	if (data == NULL) {
+		if (mapping != NULL) CloseHandle(mapping);
+		CloseHandle(file);
+		THROW_EXCEPTION("Could not map " + filename);
+	}
+}
+
+MappedFile::~MappedFile() {
+	UnmapViewOfFile(data);
+	CloseHandle(mapping);
+	CloseHandle(file);
+}
+
+void MappedFile::release(size_t offset, size_t bytes) {
+	//Written pages can only be dropped once they are on disk
+	FlushViewOfFile(data + offset, bytes);
+}
+
+#else
+
+void MappedFile::map(const std::string& filename, bool writable) {
+	data = NULL;
+	file = open(filename.c_str(), writable ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+	if (file < 0) THROW_EXCEPTION("Could not open " + filename);
+
+	if (writable) {
+		if (ftruncate(file, size) != 0) {
+			close(file);
+			THROW_EXCEPTION("Could not resize " + filename);
+		}
+	}
+	else {
+		struct stat info;
+		fstat(file, &info);
+		size = static_cast<size_t>(info.st_size);
+	}
+	if (size == 0) {
+		close(file);
+		THROW_EXCEPTION(filename + " is empty");
+	}
+
+	void* address = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+	if (address == MAP_FAILED) {
+		close(file);
+		THROW_EXCEPTION("Could not map " + filename);
+	}
+	data = static_cast<unsigned char*>(address);
+	madvise(data, size, MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile() {
+	munmap(data, size);
+	close(file);
+}
+
+void MappedFile::release(size_t offset, size_t bytes) {
+	//madvise needs a page aligned start
+	const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t start = offset - offset % page;
+	bytes += offset - start;
+
+	//Start writing back dirty pages, so they can be reclaimed like clean ones
+	msync(data + start, bytes, MS_ASYNC);
+	madvise(data + start, bytes, MADV_DONTNEED);
+}
+
+#endif
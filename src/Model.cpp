@@ -1,11 +1,13 @@
 #include "Model.h"
 
 #include "GameException.h"
+#include "Tracer.h"
 
 #include <iostream>
 #include <glm/gtc/matrix_transform.hpp>
 
 Model::Model(std::string filename, bool invert) {
+	TRACE_SCOPE("Model");
 	std::vector<float> vertex_data, normal_data, color_data;
 	aiMatrix4x4 trafo;
 	aiIdentityMatrix4(&trafo);
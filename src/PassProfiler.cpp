@@ -0,0 +1,145 @@
+#include "PassProfiler.h"
+#include "GLUtils/GLUtils.hpp"
+
+#include <iomanip>
+
+const GLenum PassProfiler::counter_targets[PassProfiler::counters_per_pass] = {
+	GL_VERTEX_SHADER_INVOCATIONS_ARB,
+	GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+	GL_COMPUTE_SHADER_INVOCATIONS_ARB,
+	GL_SAMPLES_PASSED
+};
+
+void PassTimings::print(std::ostream& out) const {
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::left << std::setw(16) << "pass" << std::right
+		<< std::setw(10) << "ms" << std::setw(12) << "vertices" << std::setw(12) << "fragments"
+		<< std::setw(12) << "compute" << std::setw(12) << "samples"
+		<< std::setw(10) << "read MB" << std::setw(10) << "write MB" << std::endl;
+	for (unsigned int i=0; i<n_passes; ++i) {
+		const PassStatistics& s = statistics[i];
+		out << std::left << std::setw(16) << names[i] << std::right << std::fixed
+			<< std::setprecision(3) << std::setw(10) << times[i]
+			<< std::setw(12) << s.vertices << std::setw(12) << s.fragments
+			<< std::setw(12) << s.compute << std::setw(12) << s.samples
+			<< std::setprecision(1) << std::setw(10) << s.bytes_read / (1024.0*1024.0)
+			<< std::setw(10) << s.bytes_written / (1024.0*1024.0) << std::endl;
+	}
+	out << "total " << std::setprecision(3) << total << " ms" << std::endl;
+	out.flags(flags);
+	out.precision(precision);
+}
+
+PassProfiler::PassProfiler() {
+	//Compute invocations are only counted where there are compute shaders
+	pipeline_statistics = (GLEW_ARB_pipeline_statistics_query == GL_TRUE);
+	counter_enabled[0] = counter_enabled[1] = pipeline_statistics;
+	counter_enabled[2] = pipeline_statistics && (GLEW_VERSION_4_3 == GL_TRUE || GLEW_ARB_compute_shader == GL_TRUE);
+	counter_enabled[3] = true;
+	for (unsigned int i=0; i<frames_in_flight; ++i) {
+		glGenQueries(queries_per_frame, frames[i].queries);
+		glGenQueries(PassTimings::max_passes*counters_per_pass, &frames[i].counters[0][0]);
+		frames[i].n_passes = 0;
+	}
+	head = 0;
+	pending = 0;
+	in_pass = false;
+	CHECK_GL_ERRORS();
+}
+
+PassProfiler::~PassProfiler() {
+	for (unsigned int i=0; i<frames_in_flight; ++i) {
+		glDeleteQueries(queries_per_frame, frames[i].queries);
+		glDeleteQueries(PassTimings::max_passes*counters_per_pass, &frames[i].counters[0][0]);
+	}
+}
+
+void PassProfiler::beginFrame() {
+	//Never overwrite queries that have not been read yet
+	if (pending == frames_in_flight) {
+		PassTimings dropped;
+		collect(dropped, true);
+	}
+
+	frames[head].n_passes = 0;
+	glQueryCounter(frames[head].queries[0], GL_TIMESTAMP);
+}
+
+void PassProfiler::endFrame() {
+	glQueryCounter(frames[head].queries[1], GL_TIMESTAMP);
+	head = (head + 1) % frames_in_flight;
+	++pending;
+}
+
+void PassProfiler::beginPass(const char* name) {
+	FrameQueries& frame = frames[head];
+	if (in_pass || frame.n_passes == PassTimings::max_passes) return;
+
+	const unsigned int pass = frame.n_passes;
+	frame.names[pass] = name;
+	frame.bytes_read[pass] = 0;
+	frame.bytes_written[pass] = 0;
+	glQueryCounter(frame.queries[2 + 2*pass], GL_TIMESTAMP);
+
+	for (unsigned int i=0; i<counters_per_pass; ++i)
+		if (counter_enabled[i]) glBeginQuery(counter_targets[i], frame.counters[pass][i]);
+	in_pass = true;
+}
+
+void PassProfiler::endPass() {
+	if (!in_pass) return;
+
+	FrameQueries& frame = frames[head];
+	for (unsigned int i=0; i<counters_per_pass; ++i)
+		if (counter_enabled[i]) glEndQuery(counter_targets[i]);
+	glQueryCounter(frame.queries[2 + 2*frame.n_passes + 1], GL_TIMESTAMP);
+	++frame.n_passes;
+	in_pass = false;
+}
+
+void PassProfiler::addTraffic(uint64_t bytes_read, uint64_t bytes_written) {
+	if (!in_pass) return;
+
+	FrameQueries& frame = frames[head];
+	frame.bytes_read[frame.n_passes] += bytes_read;
+	frame.bytes_written[frame.n_passes] += bytes_written;
+}
+
+bool PassProfiler::collect(PassTimings& timings, bool wait) {
+	if (pending == 0) return false;
+
+	FrameQueries& frame = frames[(head + frames_in_flight - pending) % frames_in_flight];
+
+	//The frame end is the last query issued, so all others are done when it is
+	GLint available = 0;
+	glGetQueryObjectiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available && !wait) return false;
+
+	GLuint64 begin, end;
+	glGetQueryObjectui64v(frame.queries[0], GL_QUERY_RESULT, &begin);
+	glGetQueryObjectui64v(frame.queries[1], GL_QUERY_RESULT, &end);
+	timings.total = (end - begin)*1e-6;
+
+	timings.n_passes = frame.n_passes;
+	for (unsigned int i=0; i<frame.n_passes; ++i) {
+		glGetQueryObjectui64v(frame.queries[2 + 2*i], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame.queries[2 + 2*i + 1], GL_QUERY_RESULT, &end);
+		timings.names[i] = frame.names[i];
+		timings.times[i] = (end - begin)*1e-6;
+
+		GLuint64 counts[counters_per_pass] = {0, 0, 0, 0};
+		for (unsigned int j=0; j<counters_per_pass; ++j)
+			if (counter_enabled[j]) glGetQueryObjectui64v(frame.counters[i][j], GL_QUERY_RESULT, &counts[j]);
+		PassStatistics& statistics = timings.statistics[i];
+		statistics.vertices = counts[0];
+		statistics.fragments = counts[1];
+		statistics.compute = counts[2];
+		statistics.samples = counts[3];
+		statistics.bytes_read = frame.bytes_read[i];
+		statistics.bytes_written = frame.bytes_written[i];
+	}
+
+	--pending;
+	return true;
+}
@@ -0,0 +1,354 @@
+#include "RecursiveBlur.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define RECURSIVEBLUR_SSE
+#include <xmmintrin.h>
+#endif
+
+const float RecursiveBlur::kernel_weights[BlurKernel::radius+1] =
+	{ 0.382925f, 0.24173f, 0.060598f, 0.005977f, 0.000229f, 0.000003f };
+
+namespace {
+
+//One RGBA pixel. The filters below are written once against these
+//helpers, which map to SSE where available.
+#ifdef RECURSIVEBLUR_SSE
+typedef __m128 Pixel;
+inline Pixel load(const float* p) { return _mm_loadu_ps(p); }
+inline void store(float* p, Pixel v) { _mm_storeu_ps(p, v); }
+inline Pixel splat(float f) { return _mm_set1_ps(f); }
+inline Pixel add(Pixel a, Pixel b) { return _mm_add_ps(a, b); }
+inline Pixel sub(Pixel a, Pixel b) { return _mm_sub_ps(a, b); }
+inline Pixel mul(Pixel a, Pixel b) { return _mm_mul_ps(a, b); }
+#else
+struct Pixel { float v[4]; };
+inline Pixel load(const float* p) { Pixel r; std::memcpy(r.v, p, sizeof(r.v)); return r; }
+inline void store(float* p, Pixel v) { std::memcpy(p, v.v, sizeof(v.v)); }
+inline Pixel splat(float f) { Pixel r = {{ f, f, f, f }}; return r; }
+inline Pixel add(Pixel a, Pixel b) { for (int i=0; i<4; ++i) a.v[i] += b.v[i]; return a; }
+inline Pixel sub(Pixel a, Pixel b) { for (int i=0; i<4; ++i) a.v[i] -= b.v[i]; return a; }
+inline Pixel mul(Pixel a, Pixel b) { for (int i=0; i<4; ++i) a.v[i] *= b.v[i]; return a; }
+#endif
+
+inline int clampIndex(int i, int n) {
+	return std::min(std::max(i, 0), n-1);
+}
+
+/**
+ * One step of the recursion: B*x + b1*w1 + b2*w2 + b3*w3
+ */
+inline Pixel step(Pixel x, Pixel w1, Pixel w2, Pixel w3,
+		Pixel B, Pixel b1, Pixel b2, Pixel b3) {
+	return add(add(mul(B, x), mul(b1, w1)), add(mul(b2, w2), mul(b3, w3)));
+}
+
+/**
+ * One row of the boundary matrix applied to the causal state's deviation from the edge
+ */
+inline Pixel boundary(const float* m, Pixel d1, Pixel d2, Pixel d3) {
+	return add(add(mul(splat(m[0]), d1), mul(splat(m[1]), d2)), mul(splat(m[2]), d3));
+}
+
+void compare(const std::vector<float>& a, const std::vector<float>& b, double& max_error, double& rms_error) {
+	max_error = 0.0;
+	double sum = 0.0;
+	for (size_t i=0; i<a.size(); ++i) {
+		double e = std::fabs(a[i] - b[i]);
+		max_error = std::max(max_error, e);
+		sum += e*e;
+	}
+	rms_error = std::sqrt(sum / a.size());
+}
+
+}
+
+RecursiveBlur::Coefficients RecursiveBlur::computeCoefficients(float sigma) {
+	//Young and van Vliet, "Recursive implementation of the Gaussian filter", 1995
+	sigma = std::max(sigma, 0.5f);
+	double q;
+	if (sigma >= 2.5f)
+		q = 0.98711*sigma - 0.96330;
+	else
+		q = 3.97156 - 4.14554*std::sqrt(1.0 - 0.26891*sigma);
+
+	const double q2 = q*q;
+	const double q3 = q2*q;
+	const double b0 = 1.57825 + 2.44413*q + 1.4281*q2 + 0.422205*q3;
+	const double b1 = 2.44413*q + 2.85619*q2 + 1.26661*q3;
+	const double b2 = -(1.4281*q2 + 1.26661*q3);
+	const double b3 = 0.422205*q3;
+
+	Coefficients c;
+	c.b1 = static_cast<float>(b1/b0);
+	c.b2 = static_cast<float>(b2/b0);
+	c.b3 = static_cast<float>(b3/b0);
+	c.B = 1.0f - (c.b1 + c.b2 + c.b3); //Unit gain, so a constant image is unchanged
+
+	//The boundary matrix is linear in the causal state, so find each column by
+	//running the filters on a unit deviation until the response has died out
+	const unsigned int n = static_cast<unsigned int>(std::ceil(20.0*sigma)) + 64;
+	std::vector<double> w(n+6), y(n+6);
+	for (unsigned int j=0; j<3; ++j) {
+		std::fill(w.begin(), w.end(), 0.0);
+		std::fill(y.begin(), y.end(), 0.0);
+		w[2-j] = 1.0; //w[0..2] hold w[N-3..N-1], x[N-1] is subtracted out
+		for (unsigned int i=3; i<n+3; ++i)
+			w[i] = c.b1*w[i-1] + c.b2*w[i-2] + c.b3*w[i-3];
+		for (unsigned int i=n+2; i>=3; --i)
+			y[i] = c.B*w[i] + c.b1*y[i+1] + c.b2*y[i+2] + c.b3*y[i+3];
+		for (unsigned int i=0; i<3; ++i)
+			c.M[i][j] = static_cast<float>(y[3+i]);
+	}
+	return c;
+}
+
+void RecursiveBlur::computeBoxSizes(float sigma, unsigned int n, unsigned int* sizes) {
+	//Pick two consecutive odd widths so that the variances of the n boxes add up to sigma^2
+	const double s2 = 12.0*sigma*sigma;
+	int wl = static_cast<int>(std::floor(std::sqrt(s2/n + 1.0)));
+	if (wl % 2 == 0) --wl;
+	wl = std::max(wl, 1);
+	const int wu = wl + 2;
+	const int m = static_cast<int>(std::floor((s2 - n*wl*wl - 4.0*n*wl - 3.0*n) / (-4.0*wl - 4.0) + 0.5));
+
+	for (unsigned int i=0; i<n; ++i)
+		sizes[i] = (static_cast<int>(i) < m) ? wl : wu;
+}
+
+void RecursiveBlur::gaussian(float* rgba, unsigned int width, unsigned int height, float sigma) {
+	if (width == 0 || height == 0) return;
+	const Coefficients c = computeCoefficients(sigma);
+	gaussianRows(rgba, width, height, c);
+	gaussianColumns(rgba, width, height, c);
+}
+
+void RecursiveBlur::gaussianRows(float* rgba, unsigned int width, unsigned int height, const Coefficients& c) {
+	const Pixel B = splat(c.B), b1 = splat(c.b1), b2 = splat(c.b2), b3 = splat(c.b3);
+
+	for (unsigned int y=0; y<height; ++y) {
+		float* row = rgba + static_cast<size_t>(y)*width*4;
+
+		//Causal pass. Starting from the edge value is the steady state for clamp-to-edge.
+		const Pixel edge = load(row + 4*(width-1));
+		Pixel w1 = load(row), w2 = w1, w3 = w1;
+		for (unsigned int x=0; x<width; ++x) {
+			Pixel w = step(load(row + 4*x), w1, w2, w3, B, b1, b2, b3);
+			store(row + 4*x, w);
+			w3 = w2; w2 = w1; w1 = w;
+		}
+
+		//Anti-causal pass over the causal result, starting from the exact boundary state
+		const Pixel d1 = sub(w1, edge), d2 = sub(w2, edge), d3 = sub(w3, edge);
+		w1 = add(edge, boundary(c.M[0], d1, d2, d3));
+		w2 = add(edge, boundary(c.M[1], d1, d2, d3));
+		w3 = add(edge, boundary(c.M[2], d1, d2, d3));
+		for (int x=width-1; x>=0; --x) {
+			Pixel w = step(load(row + 4*x), w1, w2, w3, B, b1, b2, b3);
+			store(row + 4*x, w);
+			w3 = w2; w2 = w1; w1 = w;
+		}
+	}
+}
+
+void RecursiveBlur::gaussianColumns(float* rgba, unsigned int width, unsigned int height, const Coefficients& c) {
+	const Pixel B = splat(c.B), b1 = splat(c.b1), b2 = splat(c.b2), b3 = splat(c.b3);
+	const size_t stride = static_cast<size_t>(width)*4;
+	const int h = height;
+
+	//The last input row, and the anti-causal state for the three rows past the end
+	std::vector<float> edge(rgba + (h-1)*stride, rgba + h*stride);
+	std::vector<float> tail(3*stride);
+
+	//Sweep whole rows at a time, so every column advances its recursion in lock step.
+	//Clamping the previous rows to the first row gives the clamp-to-edge steady state,
+	//because the causal filter leaves the first row unchanged.
+	for (int y=1; y<h; ++y) {
+		float* row = rgba + y*stride;
+		const float* r1 = rgba + clampIndex(y-1, h)*stride;
+		const float* r2 = rgba + clampIndex(y-2, h)*stride;
+		const float* r3 = rgba + clampIndex(y-3, h)*stride;
+		for (size_t i=0; i<stride; i+=4)
+			store(row + i, step(load(row + i), load(r1 + i), load(r2 + i), load(r3 + i), B, b1, b2, b3));
+	}
+
+	const float* r1 = rgba + (h-1)*stride;
+	const float* r2 = rgba + clampIndex(h-2, h)*stride;
+	const float* r3 = rgba + clampIndex(h-3, h)*stride;
+	for (size_t i=0; i<stride; i+=4) {
+		const Pixel e = load(&edge[i]);
+		const Pixel d1 = sub(load(r1 + i), e), d2 = sub(load(r2 + i), e), d3 = sub(load(r3 + i), e);
+		for (int k=0; k<3; ++k)
+			store(&tail[k*stride + i], add(e, boundary(c.M[k], d1, d2, d3)));
+	}
+
+	for (int y=h-1; y>=0; --y) {
+		float* row = rgba + y*stride;
+		const float* n1 = (y+1 < h) ? rgba + (y+1)*stride : &tail[(y+1-h)*stride];
+		const float* n2 = (y+2 < h) ? rgba + (y+2)*stride : &tail[(y+2-h)*stride];
+		const float* n3 = (y+3 < h) ? rgba + (y+3)*stride : &tail[(y+3-h)*stride];
+		for (size_t i=0; i<stride; i+=4)
+			store(row + i, step(load(row + i), load(n1 + i), load(n2 + i), load(n3 + i), B, b1, b2, b3));
+	}
+}
+
+void RecursiveBlur::boxCascade(float* rgba, unsigned int width, unsigned int height, float sigma, unsigned int passes) {
+	if (width == 0 || height == 0 || passes == 0) return;
+
+	std::vector<unsigned int> sizes(passes);
+	computeBoxSizes(sigma, passes, &sizes[0]);
+
+	//Ping-pong between the image and a scratch copy; the
+	//2*passes box filters always leave the result in rgba
+	std::vector<float> scratch(static_cast<size_t>(width)*height*4);
+	for (unsigned int i=0; i<passes; ++i) {
+		const unsigned int radius = sizes[i] / 2;
+		boxRows(rgba, &scratch[0], width, height, radius);
+		boxColumns(&scratch[0], rgba, width, height, radius);
+	}
+}
+
+void RecursiveBlur::boxRows(const float* in, float* out, unsigned int width, unsigned int height, unsigned int radius) {
+	const int w = width;
+	const int r = radius;
+	const Pixel scale = splat(1.0f / (2*r + 1));
+
+	for (unsigned int y=0; y<height; ++y) {
+		const float* src = in + static_cast<size_t>(y)*width*4;
+		float* dst = out + static_cast<size_t>(y)*width*4;
+
+		Pixel sum = splat(0.0f);
+		for (int i=-r; i<=r; ++i)
+			sum = add(sum, load(src + 4*clampIndex(i, w)));
+
+		//Slide the window one pixel at a time: constant cost for any radius
+		for (int x=0; x<w; ++x) {
+			store(dst + 4*x, mul(sum, scale));
+			sum = add(sum, sub(load(src + 4*clampIndex(x+r+1, w)), load(src + 4*clampIndex(x-r, w))));
+		}
+	}
+}
+
+void RecursiveBlur::boxColumns(const float* in, float* out, unsigned int width, unsigned int height, unsigned int radius) {
+	const int h = height;
+	const int r = radius;
+	const size_t stride = static_cast<size_t>(width)*4;
+	const Pixel scale = splat(1.0f / (2*r + 1));
+
+	//One running sum per column, advanced a row at a time
+	std::vector<float> sums(stride, 0.0f);
+	for (int i=-r; i<=r; ++i) {
+		const float* src = in + clampIndex(i, h)*stride;
+		for (size_t j=0; j<stride; j+=4)
+			store(&sums[j], add(load(&sums[j]), load(src + j)));
+	}
+
+	for (int y=0; y<h; ++y) {
+		float* dst = out + y*stride;
+		const float* enter = in + clampIndex(y+r+1, h)*stride;
+		const float* leave = in + clampIndex(y-r, h)*stride;
+		for (size_t j=0; j<stride; j+=4) {
+			Pixel sum = load(&sums[j]);
+			store(dst + j, mul(sum, scale));
+			store(&sums[j], add(sum, sub(load(enter + j), load(leave + j))));
+		}
+	}
+}
+
+void RecursiveBlur::convolve(float* rgba, unsigned int width, unsigned int height,
+		const float* weights, unsigned int radius) {
+	const int w = width;
+	const int h = height;
+	const int r = radius;
+	std::vector<float> tmp(static_cast<size_t>(width)*height*4);
+
+	for (int y=0; y<h; ++y) {
+		for (int x=0; x<w; ++x) {
+			for (int k=0; k<4; ++k) {
+				float sum = weights[0] * rgba[(y*w + x)*4 + k];
+				for (int i=1; i<=r; ++i)
+					sum += weights[i] * (rgba[(y*w + clampIndex(x-i, w))*4 + k] + rgba[(y*w + clampIndex(x+i, w))*4 + k]);
+				tmp[(y*w + x)*4 + k] = sum;
+			}
+		}
+	}
+
+	for (int y=0; y<h; ++y) {
+		for (int x=0; x<w; ++x) {
+			for (int k=0; k<4; ++k) {
+				float sum = weights[0] * tmp[(y*w + x)*4 + k];
+				for (int i=1; i<=r; ++i)
+					sum += weights[i] * (tmp[(clampIndex(y-i, h)*w + x)*4 + k] + tmp[(clampIndex(y+i, h)*w + x)*4 + k]);
+				rgba[(y*w + x)*4 + k] = sum;
+			}
+		}
+	}
+}
+
+std::vector<RecursiveBlur::ValidationResult> RecursiveBlur::validate(unsigned int width, unsigned int height) {
+	//Test image: noise, plus a bright square with hard edges
+	std::vector<float> image(static_cast<size_t>(width)*height*4);
+	unsigned int seed = 12345;
+	for (unsigned int y=0; y<height; ++y) {
+		for (unsigned int x=0; x<width; ++x) {
+			const bool inside = x > width/4 && x < width/2 && y > height/3 && y < 2*height/3;
+			for (unsigned int k=0; k<4; ++k) {
+				seed = seed*1664525u + 1013904223u;
+				image[(y*width + x)*4 + k] = 0.5f*(seed >> 8)/16777216.0f + (inside ? 0.5f : 0.0f);
+			}
+		}
+	}
+
+	//Exact sampled Gaussian for the wide case, truncated at four sigma
+	const float wide_sigma = 16.0f;
+	const unsigned int wide_radius = static_cast<unsigned int>(std::ceil(4.0f*wide_sigma));
+	std::vector<float> wide_weights(wide_radius+1);
+	float total = 0.0f;
+	for (unsigned int i=0; i<=wide_radius; ++i) {
+		wide_weights[i] = std::exp(-0.5f*i*i/(wide_sigma*wide_sigma));
+		total += (i == 0) ? wide_weights[i] : 2.0f*wide_weights[i];
+	}
+	for (unsigned int i=0; i<=wide_radius; ++i)
+		wide_weights[i] /= total;
+
+	struct Case { const char* filter; float sigma; };
+	const Case cases[] = {
+		{ "recursive", 1.0f }, { "box", 1.0f },
+		{ "recursive", wide_sigma }, { "box", wide_sigma }
+	};
+
+	std::vector<ValidationResult> results;
+	std::cout << "{\"blur_validation\": [" << std::endl;
+	for (unsigned int i=0; i<4; ++i) {
+		const bool wide = cases[i].sigma != 1.0f;
+		std::vector<float> reference = image;
+		if (wide)
+			convolve(&reference[0], width, height, &wide_weights[0], wide_radius);
+		else
+			convolve(&reference[0], width, height, kernel_weights, BlurKernel::radius);
+
+		std::vector<float> result = image;
+		if (std::strcmp(cases[i].filter, "recursive") == 0)
+			gaussian(&result[0], width, height, cases[i].sigma);
+		else
+			boxCascade(&result[0], width, height, cases[i].sigma);
+
+		double max_error, rms_error;
+		compare(result, reference, max_error, rms_error);
+		ValidationResult r = { cases[i].filter, cases[i].sigma, max_error, rms_error };
+		results.push_back(r);
+
+		std::cout << "\t{\"filter\": \"" << cases[i].filter << "\", \"sigma\": " << cases[i].sigma
+			<< ", \"reference\": \"" << (wide ? "fir" : "11-tap") << "\""
+			<< ", \"max_error\": " << max_error << ", \"rms_error\": " << rms_error << "}"
+			<< (i < 3 ? "," : "") << std::endl;
+	}
+	std::cout << "]}" << std::endl;
+
+	return results;
+}
@@ -0,0 +1,63 @@
+#include "ResolutionController.h"
+
+//Quality ladder, from full quality to cheapest. Pixel count
+//drops roughly 25% per step.
+const ResolutionController::Step ResolutionController::steps[] = {
+	{ 1.0f,  0 },
+	{ 0.85f, 0 },
+	{ 0.75f, 0 },
+	{ 0.75f, 1 },
+	{ 0.625f, 1 },
+	{ 0.5f,  1 },
+	{ 0.5f,  2 },
+};
+const unsigned int ResolutionController::n_steps = sizeof(steps) / sizeof(steps[0]);
+
+ResolutionController::ResolutionController(double budget_ms, unsigned int base_downscale_level) {
+	budget = budget_ms;
+	this->base_downscale_level = base_downscale_level;
+	reset();
+}
+
+void ResolutionController::reset() {
+	step = 0;
+	smoothed = 0.0;
+	frames_since_change = 0;
+	frames_under_budget = 0;
+}
+
+bool ResolutionController::update(double gpu_frame_ms) {
+	//Measurements from before the last change are still arriving
+	if (frames_since_change++ < settle_frames) {
+		smoothed = gpu_frame_ms;
+		return false;
+	}
+	smoothed = 0.8*smoothed + 0.2*gpu_frame_ms;
+
+	if (smoothed > budget && step+1 < n_steps) {
+		++step;
+		frames_since_change = 0;
+		frames_under_budget = 0;
+		return true;
+	}
+
+	//Only step up if the previous step would likely still fit
+	if (smoothed < 0.7*budget) ++frames_under_budget;
+	else frames_under_budget = 0;
+
+	if (frames_under_budget >= upgrade_frames && step > 0) {
+		--step;
+		frames_since_change = 0;
+		frames_under_budget = 0;
+		return true;
+	}
+	return false;
+}
+
+float ResolutionController::getScale() const {
+	return steps[step].scale;
+}
+
+unsigned int ResolutionController::getDownscaleLevel() const {
+	return base_downscale_level + steps[step].extra_downscale;
+}
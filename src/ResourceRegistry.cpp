@@ -0,0 +1,172 @@
+#include "ResourceRegistry.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace {
+
+struct Entry {
+	size_t bytes;
+	const char* site;
+};
+
+struct TypeStats {
+	size_t count;
+	size_t bytes;
+	size_t peak_count;
+	size_t peak_bytes;
+};
+
+/**
+ * Objects are created on the main thread during init, and on the
+ * render thread afterwards, so everything is behind a mutex
+ */
+struct Registry {
+	Registry() : bytes(0), peak_bytes(0) {
+		for (unsigned int i=0; i<RESOURCE_TYPE_COUNT; ++i)
+			types[i].count = types[i].bytes = types[i].peak_count = types[i].peak_bytes = 0;
+	}
+
+	std::mutex mutex;
+	std::map<std::pair<int, GLuint>, Entry> live;
+	TypeStats types[RESOURCE_TYPE_COUNT];
+	size_t bytes;
+	size_t peak_bytes;
+};
+
+Registry& getRegistry() {
+	static Registry registry;
+	return registry;
+}
+
+thread_local const char* current_scope = NULL;
+
+double toMB(size_t bytes) {
+	return bytes / (1024.0*1024.0);
+}
+
+}
+
+void ResourceRegistry::add(ResourceType type, GLuint name, size_t bytes) {
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	Entry entry;
+	entry.bytes = bytes;
+	entry.site = (current_scope != NULL) ? current_scope : "unscoped";
+	std::pair<std::map<std::pair<int, GLuint>, Entry>::iterator, bool> inserted =
+		registry.live.insert(std::make_pair(std::make_pair(static_cast<int>(type), name), entry));
+	if (!inserted.second) return; //Already registered
+
+	TypeStats& stats = registry.types[type];
+	++stats.count;
+	stats.bytes += bytes;
+	stats.peak_count = std::max(stats.peak_count, stats.count);
+	stats.peak_bytes = std::max(stats.peak_bytes, stats.bytes);
+	registry.bytes += bytes;
+	registry.peak_bytes = std::max(registry.peak_bytes, registry.bytes);
+}
+
+void ResourceRegistry::remove(ResourceType type, GLuint name) {
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	std::map<std::pair<int, GLuint>, Entry>::iterator it = registry.live.find(std::make_pair(static_cast<int>(type), name));
+	if (it == registry.live.end()) return;
+
+	TypeStats& stats = registry.types[type];
+	--stats.count;
+	stats.bytes -= it->second.bytes;
+	registry.bytes -= it->second.bytes;
+	registry.live.erase(it);
+}
+
+void ResourceRegistry::resize(ResourceType type, GLuint name, size_t bytes) {
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	std::map<std::pair<int, GLuint>, Entry>::iterator it = registry.live.find(std::make_pair(static_cast<int>(type), name));
+	if (it == registry.live.end()) return;
+
+	TypeStats& stats = registry.types[type];
+	stats.bytes = stats.bytes - it->second.bytes + bytes;
+	stats.peak_bytes = std::max(stats.peak_bytes, stats.bytes);
+	registry.bytes = registry.bytes - it->second.bytes + bytes;
+	registry.peak_bytes = std::max(registry.peak_bytes, registry.bytes);
+	it->second.bytes = bytes;
+}
+
+size_t ResourceRegistry::getBytes() {
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	return registry.bytes;
+}
+
+size_t ResourceRegistry::getPeakBytes() {
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	return registry.peak_bytes;
+}
+
+void ResourceRegistry::dump(std::ostream& out) {
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	out << "GL resources: " << registry.live.size() << " objects, " << toMB(registry.bytes)
+		<< " MB (peak " << toMB(registry.peak_bytes) << " MB)" << std::endl;
+	for (unsigned int i=0; i<RESOURCE_TYPE_COUNT; ++i) {
+		const TypeStats& stats = registry.types[i];
+		if (stats.peak_count == 0) continue;
+		out << "  " << getTypeName(static_cast<ResourceType>(i)) << ": " << stats.count << " objects, "
+			<< toMB(stats.bytes) << " MB (peak " << stats.peak_count << " objects, "
+			<< toMB(stats.peak_bytes) << " MB)" << std::endl;
+	}
+}
+
+bool ResourceRegistry::reportLeaks(std::ostream& out) {
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	if (registry.live.empty()) {
+		out << "No GL resources leaked (peak " << toMB(registry.peak_bytes) << " MB)" << std::endl;
+		return true;
+	}
+
+	//Group by type and creation site
+	std::map<std::pair<int, const char*>, std::pair<size_t, size_t> > groups;
+	for (std::map<std::pair<int, GLuint>, Entry>::iterator it=registry.live.begin(); it!=registry.live.end(); ++it) {
+		std::pair<size_t, size_t>& group = groups[std::make_pair(it->first.first, it->second.site)];
+		++group.first;
+		group.second += it->second.bytes;
+	}
+
+	out << "Leaked " << registry.live.size() << " GL objects, " << toMB(registry.bytes) << " MB:" << std::endl;
+	for (std::map<std::pair<int, const char*>, std::pair<size_t, size_t> >::iterator it=groups.begin(); it!=groups.end(); ++it)
+		out << "  " << it->second.first << " " << getTypeName(static_cast<ResourceType>(it->first.first))
+			<< " (" << toMB(it->second.second) << " MB) created in " << it->first.second << std::endl;
+	return false;
+}
+
+const char* ResourceRegistry::getTypeName(ResourceType type) {
+	switch (type) {
+	case RESOURCE_BUFFER: return "buffer";
+	case RESOURCE_TEXTURE: return "texture";
+	case RESOURCE_RENDERBUFFER: return "renderbuffer";
+	case RESOURCE_FRAMEBUFFER: return "framebuffer";
+	case RESOURCE_PROGRAM: return "program";
+	case RESOURCE_SHADER: return "shader";
+	case RESOURCE_VERTEX_ARRAY: return "vertex array";
+	default: return "unknown";
+	}
+}
+
+ResourceScope::ResourceScope(const char* name) {
+	previous = current_scope;
+	current_scope = name;
+}
+
+ResourceScope::~ResourceScope() {
+	current_scope = previous;
+}
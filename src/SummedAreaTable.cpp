@@ -0,0 +1,25 @@
+#include "SummedAreaTable.h"
+#include "GLUtils/GLUtils.hpp"
+#include "ResourceRegistry.h"
+
+
+SummedAreaTable::SummedAreaTable(unsigned int width, unsigned int height) {
+	this->width = width;
+	this->height = height;
+
+	//Integer textures cannot be filtered, and are only read with texelFetch
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, width, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	CHECK_GL_ERRORS();
+
+	ResourceRegistry::add(RESOURCE_TEXTURE, texture, getBytes());
+}
+
+SummedAreaTable::~SummedAreaTable() {
+	ResourceRegistry::remove(RESOURCE_TEXTURE, texture);
+	glDeleteTextures(1, &texture);
+}
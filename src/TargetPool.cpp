@@ -0,0 +1,66 @@
+#include "TargetPool.h"
+
+TargetPool::TargetPool(unsigned int max_free) {
+	this->max_free = max_free;
+	clock = 0;
+	allocations = 0;
+}
+
+TargetPool::~TargetPool() {
+}
+
+std::shared_ptr<TextureFBO> TargetPool::acquire(unsigned int width, unsigned int height, unsigned int samples) {
+	++clock;
+	for (size_t i=0; i<entries.size(); ++i) {
+		Entry& entry = entries[i];
+		if (entry.target.use_count() == 1 && entry.target->getWidth() == width && entry.target->getHeight() == height
+				&& entry.target->getSamples() == samples) {
+			entry.last_used = clock;
+			return entry.target;
+		}
+	}
+
+	trim();
+
+	Entry entry;
+	entry.target.reset(new TextureFBO(width, height, 1, samples));
+	entry.target->unbind();
+	entry.last_used = clock;
+	entries.push_back(entry);
+	++allocations;
+	return entry.target;
+}
+
+void TargetPool::clear() {
+	for (size_t i=0; i<entries.size(); ) {
+		if (entries[i].target.use_count() == 1) {
+			entries[i] = entries.back();
+			entries.pop_back();
+		}
+		else ++i;
+	}
+}
+
+unsigned int TargetPool::getInUse() {
+	unsigned int n_used = 0;
+	for (size_t i=0; i<entries.size(); ++i)
+		if (entries[i].target.use_count() != 1) ++n_used;
+	return n_used;
+}
+
+void TargetPool::trim() {
+	while (true) {
+		unsigned int n_free = 0;
+		size_t oldest = entries.size();
+		for (size_t i=0; i<entries.size(); ++i) {
+			if (entries[i].target.use_count() != 1) continue;
+			++n_free;
+			if (oldest == entries.size() || entries[i].last_used < entries[oldest].last_used)
+				oldest = i;
+		}
+		if (n_free < max_free) return;
+
+		entries[oldest] = entries.back();
+		entries.pop_back();
+	}
+}
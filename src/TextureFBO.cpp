@@ -1,38 +1,76 @@
 #include "TextureFBO.h"
+#include "GameException.h"
 #include "GLUtils/GLUtils.hpp"
+#include "ResourceRegistry.h"
 
 
-TextureFBO::TextureFBO(unsigned int width, unsigned int height) {
+TextureFBO::TextureFBO(unsigned int width, unsigned int height, unsigned int color_attachments, unsigned int samples) {
 	this->width = width;
 	this->height = height;
+	if (color_attachments == 0 || color_attachments > max_color_attachments)
+		THROW_EXCEPTION("Unsupported number of colour attachments");
+	this->color_attachments = color_attachments;
+	this->samples = samples;
+	const GLenum target = (samples > 0) ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
 
-	// Initialize Texture
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+	// Initialize Textures
+	glGenTextures(color_attachments, textures);
+	for (unsigned int i=0; i<color_attachments; ++i) {
+		glBindTexture(target, textures[i]);
+		if (samples > 0) {
+			glTexImage2DMultisample(target, samples, GL_RGBA32F, width, height, GL_TRUE);
+			continue;
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+	}
 
-	//Create depth bufferGLuint rboId;
-	glGenRenderbuffers(1, &depth);
-	glBindRenderbuffer(GL_RENDERBUFFER_EXT, depth);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	//Create the depth buffer as a texture, so later passes can read the depth
+	glGenTextures(1, &depth);
+	glBindTexture(target, depth);
+	if (samples > 0) {
+		glTexImage2DMultisample(target, samples, GL_DEPTH_COMPONENT24, width, height, GL_TRUE);
+	}
+	else {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	}
+	glBindTexture(target, 0);
 
 	// Create FBO and attach buffers
 	glGenFramebuffers(1, &fbo);
 	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	GLenum draw_buffers[max_color_attachments];
+	for (unsigned int i=0; i<color_attachments; ++i) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0+i, target, textures[i], 0);
+		draw_buffers[i] = GL_COLOR_ATTACHMENT0+i;
+	}
+	glDrawBuffers(color_attachments, draw_buffers);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, target, depth, 0);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	CHECK_GL_ERRORS();
 
+	for (unsigned int i=0; i<color_attachments; ++i)
+		ResourceRegistry::add(RESOURCE_TEXTURE, textures[i], getColorBytes() / color_attachments);
+	ResourceRegistry::add(RESOURCE_TEXTURE, depth, getDepthBytes());
+	ResourceRegistry::add(RESOURCE_FRAMEBUFFER, fbo, 0);
+
 	//FIXME: Check framebuffer complete
 }
 
 TextureFBO::~TextureFBO() {
+	ResourceRegistry::remove(RESOURCE_FRAMEBUFFER, fbo);
+	ResourceRegistry::remove(RESOURCE_TEXTURE, depth);
+	for (unsigned int i=0; i<color_attachments; ++i)
+		ResourceRegistry::remove(RESOURCE_TEXTURE, textures[i]);
 	glDeleteFramebuffersEXT(1, &fbo);
+	glDeleteTextures(1, &depth);
+	glDeleteTextures(color_attachments, textures);
 }
 
 void TextureFBO::bind() {
@@ -41,4 +79,29 @@ void TextureFBO::bind() {
 
 void TextureFBO::unbind() {
 	glBindFramebufferEXT(GL_FRAMEBUFFER, 0);
+}
+
+void TextureFBO::resolve(TextureFBO& target) {
+	if (target.width != width || target.height != height)
+		THROW_EXCEPTION("Can only resolve into a target of the same size");
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.fbo);
+
+	//A blit writes to every draw buffer, so copy one attachment at a time
+	GLenum draw_buffers[max_color_attachments];
+	for (unsigned int i=0; i<target.color_attachments; ++i) {
+		draw_buffers[i] = GL_COLOR_ATTACHMENT0+i;
+		if (i >= color_attachments) continue;
+		glReadBuffer(GL_COLOR_ATTACHMENT0+i);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0+i);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+				GL_COLOR_BUFFER_BIT | (i == 0 ? GL_DEPTH_BUFFER_BIT : 0), GL_NEAREST);
+	}
+
+	//The read and draw buffers are part of each framebuffer's state
+	glDrawBuffers(target.color_attachments, draw_buffers);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	CHECK_GL_ERRORS();
 }
\ No newline at end of file
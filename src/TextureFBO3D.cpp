@@ -0,0 +1,52 @@
+#include "TextureFBO3D.h"
+#include "GLUtils/GLUtils.hpp"
+#include "ResourceRegistry.h"
+
+
+TextureFBO3D::TextureFBO3D(unsigned int width, unsigned int height, unsigned int depth) {
+	this->width = width;
+	this->height = height;
+	this->depth = depth;
+
+	// Initialize Texture, filtered trilinearly when sampled
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_3D, texture);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, width, height, depth, 0, GL_RGBA, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_3D, 0);
+
+	// Create FBO and attach every layer of the texture
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteTextures(1, &texture);
+		THROW_EXCEPTION("Layered framebuffer is not complete");
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	CHECK_GL_ERRORS();
+
+	ResourceRegistry::add(RESOURCE_TEXTURE, texture, getBytes());
+	ResourceRegistry::add(RESOURCE_FRAMEBUFFER, fbo, 0);
+}
+
+TextureFBO3D::~TextureFBO3D() {
+	ResourceRegistry::remove(RESOURCE_FRAMEBUFFER, fbo);
+	ResourceRegistry::remove(RESOURCE_TEXTURE, texture);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteTextures(1, &texture);
+}
+
+void TextureFBO3D::bind() {
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+void TextureFBO3D::unbind() {
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,233 @@
+#include "TiledFilter.h"
+#include "GameException.h"
+#include "GLUtils/GLUtils.hpp"
+#include "ImageIO.h"
+#include "ResourceRegistry.h"
+#include "Tracer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+TiledFilter::TiledFilter(const std::string& input_file, const std::string& output_file, unsigned int tile_size, unsigned int halo) {
+	this->tile_size = tile_size;
+	this->halo = halo;
+	if (tile_size <= 2*halo) THROW_EXCEPTION("The tiles are too small for the filter radius");
+	core = tile_size - 2*halo;
+
+	input.reset(new MappedFile(input_file));
+	input_offset = ImageIO::readPNMHeader(input->getData(), input->getSize(), width, height, channels, max_value);
+
+	std::stringstream header;
+	header << "P6\n" << width << " " << height << "\n255\n";
+	output_offset = header.str().size();
+	output.reset(new MappedFile(output_file, output_offset + static_cast<size_t>(width)*height*3));
+	std::memcpy(output->getData(), header.str().c_str(), output_offset);
+
+	tiles_x = (width + core - 1) / core;
+	tiles_y = (height + core - 1) / core;
+	tile = -1;
+	input_released = 0;
+	output_released = 0;
+	upload_head = 0;
+	readback_head = 0;
+	in_flight = 0;
+	finished = false;
+
+	const size_t upload_bytes = static_cast<size_t>(tile_size)*tile_size*4;
+	const size_t readback_bytes = static_cast<size_t>(core)*core*4;
+	ResourceScope scope("TiledFilter");
+	glGenBuffers(ring_size, upload_pbos);
+	glGenBuffers(ring_size, readback_pbos);
+	for (unsigned int i=0; i<ring_size; ++i) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_pbos[i]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, upload_bytes, NULL, GL_STREAM_DRAW);
+		ResourceRegistry::add(RESOURCE_BUFFER, upload_pbos[i], upload_bytes);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, readback_bytes, NULL, GL_STREAM_READ);
+		ResourceRegistry::add(RESOURCE_BUFFER, readback_pbos[i], readback_bytes);
+		upload_fences[i] = 0;
+		readback_fences[i] = 0;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	CHECK_GL_ERRORS();
+
+	start = std::chrono::steady_clock::now();
+	std::cout << "Filtering " << width << "x" << height << " in " << tiles_x*tiles_y << " tiles of "
+		<< tile_size << "x" << tile_size << " with a halo of " << halo << std::endl;
+}
+
+TiledFilter::~TiledFilter() {
+	finish();
+}
+
+void TiledFilter::finish() {
+	if (finished) return;
+	finished = true;
+
+	while (in_flight > 0)
+		retire(true);
+
+	for (unsigned int i=0; i<ring_size; ++i) {
+		if (upload_fences[i] != 0) glDeleteSync(upload_fences[i]);
+		ResourceRegistry::remove(RESOURCE_BUFFER, upload_pbos[i]);
+		ResourceRegistry::remove(RESOURCE_BUFFER, readback_pbos[i]);
+	}
+	glDeleteBuffers(ring_size, upload_pbos);
+	glDeleteBuffers(ring_size, readback_pbos);
+
+	//Unmapping writes back the rest of the output
+	input.reset();
+	output.reset();
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Filtered " << width*static_cast<double>(height)*1e-6 << " Mpixel in " << seconds << " s ("
+		<< width*static_cast<double>(height)*1e-6 / std::max(seconds, 1e-6) << " Mpixel/s)" << std::endl;
+}
+
+bool TiledFilter::next() {
+	if (tile + 1 >= static_cast<int>(tiles_x*tiles_y)) return false;
+	++tile;
+
+	//At the start of a row of tiles, the rows above it are done
+	if (tile % tiles_x == 0 && tile > 0) {
+		while (in_flight > 0)
+			retire(true);
+		const unsigned int y0 = (tile / tiles_x) * core;
+		releaseRows(y0, y0 > halo ? y0 - halo : 0);
+	}
+	return true;
+}
+
+void TiledFilter::releaseRows(unsigned int output_rows, unsigned int input_rows) {
+	const size_t input_row_bytes = static_cast<size_t>(width)*channels;
+	const size_t output_row_bytes = static_cast<size_t>(width)*3;
+
+	if (input_rows > input_released) {
+		input->release(input_offset + input_released*input_row_bytes, (input_rows - input_released)*input_row_bytes);
+		input_released = input_rows;
+	}
+	if (output_rows > output_released) {
+		output->release(output_offset + output_released*output_row_bytes, (output_rows - output_released)*output_row_bytes);
+		output_released = output_rows;
+	}
+}
+
+void TiledFilter::upload(TextureFBO& target) {
+	TRACE_SCOPE("upload tile");
+	const unsigned int slot = upload_head;
+	upload_head = (upload_head + 1) % ring_size;
+
+	//The buffer was last used ring_size tiles ago, so this normally does not wait
+	if (upload_fences[slot] != 0) {
+		GLUtils::waitSync(upload_fences[slot]);
+		glDeleteSync(upload_fences[slot]);
+		upload_fences[slot] = 0;
+	}
+
+	const size_t bytes = static_cast<size_t>(tile_size)*tile_size*4;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_pbos[slot]);
+	unsigned char* rgba = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	if (rgba == NULL) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		THROW_EXCEPTION("Could not map the upload buffer");
+	}
+
+	//Gather the tile and its halo straight from the mapped file into
+	//the buffer, repeating the edge pixels outside the image
+	const int left = static_cast<int>((tile % tiles_x) * core) - static_cast<int>(halo);
+	const int top = static_cast<int>((tile / tiles_x) * core) - static_cast<int>(halo);
+	const int first = std::max(left, 0);
+	const int last = std::min(left + static_cast<int>(tile_size), static_cast<int>(width)); //< One past the last column
+	for (unsigned int row=0; row<tile_size; ++row) {
+		const int y = std::min(std::max(top + static_cast<int>(row), 0), static_cast<int>(height) - 1);
+		const unsigned char* samples = input->getData() + input_offset + (static_cast<size_t>(y)*width + first)*channels;
+		unsigned char* dst = rgba + static_cast<size_t>(row)*tile_size*4;
+
+		ImageIO::expandPNM(samples, channels, max_value, dst + (first - left)*4, last - first);
+		for (int x=left; x<first; ++x)
+			std::memcpy(dst + (x - left)*4, dst + (first - left)*4, 4);
+		for (int x=last; x<left+static_cast<int>(tile_size); ++x)
+			std::memcpy(dst + (x - left)*4, dst + (last - 1 - left)*4, 4);
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	glBindTexture(GL_TEXTURE_2D, target.getTexture());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tile_size, tile_size, GL_RGBA, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	upload_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	CHECK_GL_ERRORS();
+}
+
+void TiledFilter::readback(TextureFBO& source) {
+	if (in_flight == ring_size)
+		retire(true);
+
+	Pending& p = pending[readback_head];
+	p.x = (tile % tiles_x) * core;
+	p.y = (tile / tiles_x) * core;
+	p.width = std::min(core, width - p.x);
+	p.height = std::min(core, height - p.y);
+
+	//Only the core is read, the halo was just there for the filter
+	source.bind();
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_pbos[readback_head]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(halo, halo, p.width, p.height, GL_RGBA, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	source.unbind();
+	readback_fences[readback_head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	CHECK_GL_ERRORS();
+
+	readback_head = (readback_head + 1) % ring_size;
+	++in_flight;
+
+	while (in_flight > 0 && retire(false));
+}
+
+bool TiledFilter::retire(bool block) {
+	const unsigned int oldest = (readback_head + ring_size - in_flight) % ring_size;
+
+	if (block) {
+		GLUtils::waitSync(readback_fences[oldest]);
+	}
+	else {
+		GLenum status = glClientWaitSync(readback_fences[oldest], 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) return false;
+		if (status == GL_WAIT_FAILED) THROW_EXCEPTION("Waiting for the readback fence failed");
+	}
+	glDeleteSync(readback_fences[oldest]);
+	readback_fences[oldest] = 0;
+	--in_flight;
+
+	TRACE_SCOPE("write tile");
+	const Pending& p = pending[oldest];
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_pbos[oldest]);
+	const unsigned char* rgba = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+			static_cast<size_t>(p.width)*p.height*4, GL_MAP_READ_BIT));
+	if (rgba == NULL) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		THROW_EXCEPTION("Could not map the readback buffer");
+	}
+
+	//Scatter the core into its place in the output, dropping alpha
+	for (unsigned int row=0; row<p.height; ++row) {
+		const unsigned char* src = rgba + static_cast<size_t>(row)*p.width*4;
+		unsigned char* dst = output->getData() + output_offset + ((p.y + static_cast<size_t>(row))*width + p.x)*3;
+		for (unsigned int x=0; x<p.width; ++x) {
+			dst[3*x] = src[4*x];
+			dst[3*x+1] = src[4*x+1];
+			dst[3*x+2] = src[4*x+2];
+		}
+	}
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	CHECK_GL_ERRORS();
+	return true;
+}
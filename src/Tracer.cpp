@@ -0,0 +1,135 @@
+#include "Tracer.h"
+#include "GameException.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Tracer::enabled(false);
+
+namespace {
+
+struct TraceEvent {
+	const char* name;
+	uint64_t begin, end;
+};
+
+/**
+ * Events of one thread. Only the owning thread appends, and publishes
+ * each event by incrementing count, so the writer needs no lock.
+ */
+struct ThreadBuffer {
+	ThreadBuffer(unsigned int id, const char* name) : count(0), dropped(0), id(id), name(name) {}
+
+	TraceEvent events[Tracer::events_per_thread];
+	std::atomic<unsigned int> count;
+	std::atomic<unsigned int> dropped;
+	const unsigned int id;
+	const char* name;
+};
+
+/**
+ * Every thread's buffer. The buffers live until exit, as the
+ * trace is usually written after the threads have finished.
+ */
+struct Registry {
+	Registry() : epoch(0) {}
+	~Registry() {
+		for (size_t i=0; i<buffers.size(); ++i)
+			delete buffers[i];
+	}
+
+	std::mutex mutex; //< Only taken when a thread records its first event, and when writing
+	std::vector<ThreadBuffer*> buffers;
+	uint64_t epoch; //< When tracing was first enabled, the trace starts at zero
+};
+
+Registry& getRegistry() {
+	static Registry registry;
+	return registry;
+}
+
+thread_local ThreadBuffer* thread_buffer = NULL;
+thread_local const char* thread_name = NULL;
+
+ThreadBuffer* getThreadBuffer() {
+	if (thread_buffer == NULL) {
+		Registry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		thread_buffer = new ThreadBuffer(static_cast<unsigned int>(registry.buffers.size()) + 1, thread_name);
+		registry.buffers.push_back(thread_buffer);
+	}
+	return thread_buffer;
+}
+
+}
+
+void Tracer::setEnabled(bool enabled) {
+	if (enabled) {
+		//Scopes only record when they begin while enabled, so none begin before this
+		Registry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		if (registry.epoch == 0) registry.epoch = Timer::getCurrentTimeNs();
+	}
+	Tracer::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Tracer::setThreadName(const char* name) {
+	thread_name = name;
+	if (thread_buffer != NULL) thread_buffer->name = name;
+}
+
+void Tracer::record(const char* name, uint64_t begin, uint64_t end) {
+	ThreadBuffer* buffer = getThreadBuffer();
+	const unsigned int n = buffer->count.load(std::memory_order_relaxed);
+	if (n == events_per_thread) {
+		buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	TraceEvent& event = buffer->events[n];
+	event.name = name;
+	event.begin = begin;
+	event.end = end;
+	buffer->count.store(n + 1, std::memory_order_release);
+}
+
+void Tracer::write(const std::string& filename) {
+	std::ofstream file(filename.c_str());
+	if (!file.good()) {
+		std::string err = "Could not open ";
+		err.append(filename);
+		THROW_EXCEPTION(err);
+	}
+
+	Registry& registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	//Times in microseconds, with nanosecond precision
+	char line[256];
+	unsigned int events = 0, dropped = 0;
+	file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	for (size_t i=0; i<registry.buffers.size(); ++i) {
+		const ThreadBuffer& buffer = *registry.buffers[i];
+		if (i > 0) file << ",";
+		file << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer.id
+			<< ", \"args\": {\"name\": \"" << (buffer.name ? buffer.name : "thread") << "\"}}";
+
+		const unsigned int n = buffer.count.load(std::memory_order_acquire);
+		for (unsigned int j=0; j<n; ++j) {
+			const TraceEvent& event = buffer.events[j];
+			std::snprintf(line, sizeof(line), ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+					event.name, buffer.id, (event.begin - registry.epoch)*1e-3, (event.end - event.begin)*1e-3);
+			file << line;
+		}
+		events += n;
+		dropped += buffer.dropped.load(std::memory_order_relaxed);
+	}
+	file << "\n]}\n";
+
+	std::cout << "Wrote " << events << " trace events to " << filename;
+	if (dropped > 0) std::cout << " (" << dropped << " dropped, the buffers were full)";
+	std::cout << std::endl;
+}
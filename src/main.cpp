@@ -1,19 +1,97 @@
 #include "GameManager.h"
+#include "Tracer.h"
+#include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <string>
 
 #ifdef _WIN32
 #include <Windows.h>
 #endif
 
+namespace {
+	void printUsage(const char* program) {
+		std::cerr << "Usage: " << program << " [--record <trace>] [--replay <trace>] [--headless] [--trace <json>]" << std::endl
+			<< "       " << program << " --batch <input dir> <output dir> [--filter blur|greyscale|combo] [--trace <json>]" << std::endl
+			<< "       " << program << " --tiled <input> <output> [--tile-size <n>] [--filter blur|greyscale|combo] [--trace <json>]" << std::endl
+			<< "  --record <trace>  Write the input of this session to <trace>" << std::endl
+			<< "  --replay <trace>  Replay the input in <trace> one frame at a time, then exit" << std::endl
+			<< "  --headless        Render to a hidden window" << std::endl
+			<< "  --trace <json>    Write the CPU time of startup and each frame as a Chrome trace" << std::endl
+			<< "  --batch <in> <out> Filter every PGM/PPM image in <in> into PNGs in <out>, then exit" << std::endl
+			<< "  --tiled <in> <out> Filter a PGM/PPM of any size in tiles into the PPM <out>, then exit" << std::endl
+			<< "  --tile-size <n>   Tile size of --tiled, 2048 by default" << std::endl
+			<< "  --filter <name>   Filter used by --batch and --tiled, combo by default" << std::endl;
+	}
+
+	bool parseFilter(const std::string& name, RenderMode& mode) {
+		for (int i=0; i<RenderMode::RENDER_MODE_COUNT; ++i) {
+			if (name == GameManager::getRenderModeName(static_cast<RenderMode>(i))) {
+				mode = static_cast<RenderMode>(i);
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
 /**
  * Simple program that starts our game manager
  */
 int main(int argc, char *argv[]) {
+	std::string record_file, replay_file, trace_file, batch_input, batch_output, tiled_input, tiled_output;
+	unsigned int tile_size = 2048;
+	RenderMode batch_filter = RenderMode::COMBO;
+	bool headless = false;
+	for (int i=1; i<argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--record" && i+1 < argc) record_file = argv[++i];
+		else if (arg == "--replay" && i+1 < argc) replay_file = argv[++i];
+		else if (arg == "--headless") headless = true;
+		else if (arg == "--trace" && i+1 < argc) trace_file = argv[++i];
+		else if (arg == "--batch" && i+2 < argc) {
+			batch_input = argv[++i];
+			batch_output = argv[++i];
+		}
+		else if (arg == "--tiled" && i+2 < argc) {
+			tiled_input = argv[++i];
+			tiled_output = argv[++i];
+		}
+		else if (arg == "--tile-size" && i+1 < argc) tile_size = std::atoi(argv[++i]);
+		else if (arg == "--filter" && i+1 < argc && parseFilter(argv[i+1], batch_filter)) ++i;
+		else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (headless && replay_file.empty()) {
+		std::cerr << "--headless needs --replay, there is no input otherwise" << std::endl;
+		return 1;
+	}
+
+	if (!trace_file.empty()) {
+		Tracer::setThreadName("main");
+		Tracer::setEnabled(true);
+	}
+
 	std::shared_ptr<GameManager> game;
 	game.reset(new GameManager());
-	game->init();
-	game->play();
+	if (!replay_file.empty()) game->setInputReplay(replay_file);
+	if (!record_file.empty()) game->setInputRecording(record_file);
+	if (!batch_input.empty()) {
+		game->init(true);
+		game->filterImages(batch_input, batch_output, batch_filter);
+	}
+	else if (!tiled_input.empty()) {
+		game->init(true);
+		game->filterLargeImage(tiled_input, tiled_output, batch_filter, tile_size);
+	}
+	else {
+		game->init(headless);
+		game->play();
+	}
 	game.reset();
+
+	if (!trace_file.empty()) Tracer::write(trace_file);
 	return 0;
 }